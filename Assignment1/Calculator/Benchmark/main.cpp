@@ -0,0 +1,358 @@
+//
+//  main.cpp
+//  Benchmark
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+//  benchmark of the Calculator on generated scripts, with and without its optimize pass, and of its dispatch cost per
+//  token with --dispatch, build it with
+//  g++ -std=c++14 -O2 -I../Calculator main.cpp -o Benchmark
+//
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Calculator.h"
+
+namespace {
+    struct Options {
+        size_t size = 200000;
+        unsigned repeat = 3;
+        unsigned seed = 1;
+        bool dispatch = false;
+    };
+
+    void printUsage() {
+        std::cout << "usage: Benchmark [options]\n"
+                  << "  --size N      blocks in each generated script, 200000 by default\n"
+                  << "  --repeat R    runs of each script and mode, 3 by default\n"
+                  << "  --seed S      seed of the generator, 1 by default\n"
+                  << "  --dispatch    time resolving keywords and running instructions per token instead" << std::endl;
+    }
+
+    Options parseOptions(int argc, const char *argv[]) {
+        Options options;
+        for (int i = 1; i < argc; ++i) {
+            std::string name = argv[i];
+            if (name == "--dispatch") {
+                options.dispatch = true;
+                continue;
+            }
+            if (i + 1 == argc) {
+                throw std::invalid_argument("missing value of " + name);
+            }
+            std::string value = argv[++i];
+            if (name == "--size") {
+                options.size = std::stoull(value);
+            } else if (name == "--repeat") {
+                options.repeat = static_cast<unsigned>(std::stoul(value));
+                if (options.repeat == 0) {
+                    throw std::invalid_argument("repeat must be at least 1");
+                }
+            } else if (name == "--seed") {
+                options.seed = static_cast<unsigned>(std::stoul(value));
+            } else {
+                throw std::invalid_argument("unknown option " + name);
+            }
+        }
+        return options;
+    }
+
+    // chains of operations on literals only, like '10 20 sub 4 3 add 2 mult', most of them popped again and half of
+    // them repeated
+    std::string makeConstant(const Options &options) {
+        std::mt19937 mt(options.seed);
+        std::uniform_int_distribution<int> integer(1, 99);
+        std::uniform_int_distribution<int> op(0, 3);
+        const char *ops[] = {" add", " sub", " mult", " div"};
+        std::ostringstream script;
+        for (size_t block = 0; block < options.size; ++block) {
+            bool isRepeated = block % 2;
+            if (isRepeated) {
+                script << 1 + mt() % 20 << " repeat ";
+            }
+            script << integer(mt) << ' ' << integer(mt) << ops[op(mt)];
+            for (int k = 0; k < 3; k++) {
+                int next = op(mt);
+                if (next == 3 || mt() % 2) {
+                    script << ' ' << integer(mt) << '.' << integer(mt) << ops[next];// an integer result may be 0
+                } else {
+                    script << ' ' << integer(mt) << ops[next];
+                }
+            }
+            script << (block % 8 ? " pop" : "") << (isRepeated ? " endrepeat\n" : "\n");
+        }
+        return script.str();
+    }
+
+    // repeats whose body only adds to or multiplies the top, like '1 20 repeat 2 mult endrepeat'
+    std::string makeScale(const Options &options) {
+        std::mt19937 mt(options.seed);
+        std::ostringstream script;
+        for (size_t block = 0; block < options.size; ++block) {
+            if (block % 2) {
+                script << mt() % 10 << ' ' << 1 + mt() % 100 << " repeat " << mt() % 10 << " add endrepeat";
+            } else {
+                script << 1 + mt() % 3 << ' ' << 1 + mt() % 15 << " repeat 2 mult endrepeat";
+            }
+            script << (block % 8 ? " pop\n" : "\n");
+        }
+        return script.str();
+    }
+
+    // operations on the running result, which leave optimize nothing to do
+    std::string makeMixed(const Options &options) {
+        std::mt19937 mt(options.seed);
+        const char *blocks[] = {"2 mult", "1.5 add", "sqrt", "3 sub", "4 div", "2 2 reverse div"};
+        std::ostringstream script;
+        script << "1";
+        for (size_t block = 0; block < options.size; ++block) {
+            script << ' ' << blocks[mt() % 6];
+        }
+        script << '\n';
+        return script.str();
+    }
+
+    // a stream buffer that only hashes what is written to it, to check two runs printed the same
+    class HashBuffer : public std::streambuf {
+
+    private:
+        unsigned long long hash = 14695981039346656037ull;
+
+    protected:
+        std::streamsize xsputn(const char *s, std::streamsize length) override {
+            for (std::streamsize k = 0; k < length; k++) {
+                hash = (hash ^ static_cast<unsigned char>(s[k])) * 1099511628211ull;
+            }
+            return length;
+        }
+
+        int_type overflow(int_type c) override {
+            if (c != traits_type::eof()) {
+                char character = static_cast<char>(c);
+                xsputn(&character, 1);
+            }
+            return c;
+        }
+
+    public:
+        unsigned long long getHash() const {
+            return hash;
+        }
+    };
+
+    // seconds to run script, hash is set to a hash of what it printed and its final stack
+    double runScript(const std::string &script, bool isTraced, bool isOptimized, unsigned long long &hash) {
+        std::istringstream in(script);
+        HashBuffer buffer;
+        std::ostream os(&buffer);
+        auto start = std::chrono::steady_clock::now();
+        {
+            Output output(os);
+            VirtualMachine vm;
+            if (isTraced) {
+                vm.setTrace(&output);
+            }
+            runScript(in, vm, isOptimized);
+            for (auto const& number: vm.getStack()) {
+                output << number << '\n';
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        hash = buffer.getHash();
+        return elapsed.count();
+    }
+
+    double getMedian(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        size_t middle = values.size() / 2;
+        return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+    }
+
+    /**
+     *the chain of compares Compiler resolved keywords with before toOpCode, kept as the reference it is timed against
+     */
+    OpCode toOpCodeByCompares(const char *token, size_t length) {
+        if (isKeyword(token, length, "add")) {
+            return OpCode::Add;
+        } else if (isKeyword(token, length, "sub")) {
+            return OpCode::Sub;
+        } else if (isKeyword(token, length, "mult")) {
+            return OpCode::Mult;
+        } else if (isKeyword(token, length, "div")) {
+            return OpCode::Div;
+        } else if (isKeyword(token, length, "sqrt")) {
+            return OpCode::Sqrt;
+        } else if (isKeyword(token, length, "pop")) {
+            return OpCode::Pop;
+        } else if (isKeyword(token, length, "reverse")) {
+            return OpCode::Reverse;
+        } else if (isKeyword(token, length, "repeat")) {
+            return OpCode::RepeatBegin;
+        } else if (isKeyword(token, length, "endrepeat")) {
+            return OpCode::RepeatEnd;
+        }
+        return OpCode::Push;
+    }
+
+    /**
+     *whether toOpCode gives the same opcode as toOpCodeByCompares for every token, for the keywords and for tokens
+     *that land in the same slot of the hash as one: the keyword with another last character, with its first character
+     *32 away (so in upper case), one character longer or shorter
+     */
+    bool checkResolvers(const std::vector<std::pair<const char *, size_t>> &tokens) {
+        std::vector<std::string> checked = {"1", "-3", "2.5", "x", "repeat1", "endrepea"};
+        for (const char *keyword: {"add", "sub", "mult", "div", "sqrt", "pop", "reverse", "repeat", "endrepeat"}) {
+            std::string text = keyword;
+            checked.push_back(text);
+            std::string other = text;
+            other.back() = 'x';
+            checked.push_back(other);
+            other = text;
+            other[0] = static_cast<char>(other[0] - 32);
+            checked.push_back(other);
+            checked.push_back(text + "s");
+            checked.push_back(text.substr(0, text.size() - 1));
+        }
+        // other first characters in the same slot: 'subb' is in the one of 'sqrt', 'f' in the one of 'div'
+        checked.push_back("subb");
+        checked.push_back("f");
+        bool isSame = true;
+        for (auto const& token: checked) {
+            if (toOpCode(token.data(), token.size()) != toOpCodeByCompares(token.data(), token.size())) {
+                std::cout << "  '" << token << "' resolves to different opcodes" << std::endl;
+                isSame = false;
+            }
+        }
+        size_t differentNum = 0;
+        for (auto const& token: tokens) {
+            if (toOpCode(token.first, token.second) != toOpCodeByCompares(token.first, token.second)) {
+                differentNum++;
+            }
+        }
+        if (differentNum > 0) {
+            std::cout << "  " << differentNum << " tokens of the script resolve to different opcodes" << std::endl;
+            isSame = false;
+        }
+        return isSame;
+    }
+
+    // nanoseconds per token to resolve all tokens with resolve, sum is set to a sum of the opcodes so that the work
+    // is not optimised away
+    template <typename Resolve>
+    double timeResolve(const std::vector<std::pair<const char *, size_t>> &tokens, Resolve resolve, unsigned &sum) {
+        auto start = std::chrono::steady_clock::now();
+        sum = 0;
+        for (auto const& token: tokens) {
+            sum += static_cast<unsigned>(resolve(token.first, token.second));
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / tokens.size();
+    }
+
+    bool benchmarkDispatch(const Options &options) {
+        std::string script = makeConstant(options) + makeScale(options) + makeMixed(options);
+        std::vector<std::pair<const char *, size_t>> tokens;
+        for (size_t begin = 0; begin < script.size();) {
+            size_t end = begin;
+            while (end < script.size() && !std::isspace(static_cast<unsigned char>(script[end]))) {
+                end++;
+            }
+            if (end != begin) {
+                tokens.push_back({script.data() + begin, end - begin});
+            }
+            begin = end + 1;
+        }
+
+        std::cout << "dispatch, " << tokens.size() << " tokens" << std::endl;
+        const bool isSame = checkResolvers(tokens);
+
+        std::vector<double> comparesNanoseconds;
+        std::vector<double> hashNanoseconds;
+        unsigned comparesSum = 0;
+        unsigned hashSum = 0;
+        for (unsigned run = 0; run < options.repeat; ++run) {
+            comparesNanoseconds.push_back(timeResolve(tokens, toOpCodeByCompares, comparesSum));
+            hashNanoseconds.push_back(timeResolve(tokens, toOpCode, hashSum));
+        }
+        double compares = getMedian(comparesNanoseconds);
+        double hashed = getMedian(hashNanoseconds);
+        std::cout << "  resolve: compares " << compares << " ns/token, perfect hash " << hashed << " ns/token, speedup "
+                  << compares / hashed << (isSame ? "" : ", OPCODES DIFFER") << std::endl;
+        volatile unsigned sink = comparesSum + hashSum;
+        (void)sink;
+
+        // a long run of '1 pop' costs the VM two dispatches per literal and nothing else
+        Compiler compiler;
+        for (size_t k = 0; k < tokens.size() / 2; k++) {
+            compiler.add("1", 1);
+            compiler.add("pop", 3);
+        }
+        std::vector<double> runNanoseconds;
+        for (unsigned run = 0; run < options.repeat; ++run) {
+            VirtualMachine vm;
+            auto start = std::chrono::steady_clock::now();
+            vm.run(compiler.getProgram());
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            runNanoseconds.push_back(elapsed.count() / compiler.getProgram().code.size());
+        }
+        std::cout << "  run: " << getMedian(runNanoseconds) << " ns/instruction of push and pop" << std::endl;
+        return isSame;
+    }
+}
+
+int main(int argc, const char *argv[]) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        printUsage();
+        return 2;
+    }
+
+    std::cout << std::fixed << std::setprecision(4);
+    if (options.dispatch) {
+        return benchmarkDispatch(options) ? 0 : 1;
+    }
+
+    std::vector<std::pair<std::string, std::string>> scripts = {
+        {"constant", makeConstant(options)},
+        {"scale", makeScale(options)},
+        {"mixed", makeMixed(options)}
+    };
+
+    bool isCorrect = true;
+    for (auto const& script: scripts) {
+        std::cout << script.first << ", " << script.second.size() / 1e6 << " MB" << std::endl;
+        for (bool isTraced: {true, false}) {
+            std::vector<double> plainSeconds;
+            std::vector<double> optimizedSeconds;
+            unsigned long long plainHash = 0;
+            unsigned long long optimizedHash = 0;
+            for (unsigned run = 0; run < options.repeat; ++run) {
+                plainSeconds.push_back(runScript(script.second, isTraced, false, plainHash));
+                optimizedSeconds.push_back(runScript(script.second, isTraced, true, optimizedHash));
+                if (plainHash != optimizedHash) {
+                    isCorrect = false;
+                }
+            }
+            double plain = getMedian(plainSeconds);
+            double optimized = getMedian(optimizedSeconds);
+            std::cout << "  " << (isTraced ? "traced" : "quiet ") << ": plain " << plain << " s, optimized " << optimized
+                      << " s, speedup " << plain / optimized << (plainHash == optimizedHash ? "" : ", OUTPUT DIFFERS")
+                      << std::endl;
+        }
+    }
+    std::cout << (isCorrect ? "optimized runs printed the same" : "verification FAILED") << std::endl;
+    return isCorrect ? 0 : 1;
+}
@@ -0,0 +1,735 @@
+//
+//  Calculator.h
+//  Calculator
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#ifndef Calculator_h
+#define Calculator_h
+
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+//a class for parsing token, also the value kept on the stack
+class Number {
+    
+private:
+    bool int_or_double;
+    union {
+        int i;
+        double d;
+    };
+    
+    bool isInteger(const char *s, size_t length) {
+        return length != 0
+        && std::find_if(s, s + length, [](char c) {return !std::isdigit(c);}) == s + length;
+    }
+    
+public:
+    // parse a token, throws the same exceptions std::stoi and std::stod do
+    Number(const char *s, size_t length) {
+        if (isInteger(s, length)) {
+            long long value = 0;
+            for (size_t k = 0; k < length; k++) {
+                value = value * 10 + (s[k] - '0');
+                if (value > std::numeric_limits<int>::max()) {
+                    throw std::out_of_range("stoi");
+                }
+            }
+            i = static_cast<int>(value);
+            int_or_double = true;
+        } else {
+            // strtod needs a '\0' after the token, which is copied for it
+            char buffer[64];
+            std::string copy;
+            const char *text = buffer;
+            if (length < sizeof(buffer)) {
+                std::memcpy(buffer, s, length);
+                buffer[length] = '\0';
+            } else {
+                copy.assign(s, length);
+                text = copy.c_str();
+            }
+            char *end;
+            errno = 0;
+            d = std::strtod(text, &end);
+            if (end == text) {
+                throw std::invalid_argument("stod");
+            }
+            if (errno == ERANGE) {
+                throw std::out_of_range("stod");
+            }
+            int_or_double = false;
+        }
+    }
+    
+    Number(int i) {
+        this->i = i;
+        int_or_double = true;
+    }
+    
+    Number(double d) {
+        this->d = d;
+        int_or_double = false;
+    }
+    
+    bool is_int_or_double () const {
+        return int_or_double;
+    }
+    
+    int getIntegerValue() const {
+        return int_or_double ? i : static_cast<int>(d);
+    }
+    
+    double getDoubleValue() const {
+        return int_or_double ? i : d;
+    }
+    
+    // the number as std::to_string writes it and the constructor reads it back, which is how results are kept:
+    // a negative integer turns into a double ('-' is not a digit) and a double keeps 6 decimals
+    Number toStored() const {
+        if (int_or_double) {
+            return i < 0 ? Number(static_cast<double>(i)) : *this;
+        }
+        // below 1e9 a double is within half a unit of its 6th decimal of the closest k / 1e6, so it is kept as it
+        // is when it is that closest double already
+        if (std::fabs(d) < 1e9 && std::nearbyint(d * 1e6) / 1e6 == d) {
+            return *this;
+        }
+        return Number(std::stod(std::to_string(d)));
+    }
+};
+
+//collects what is printed in a block written out only when it is full or at the end, numbers are formatted without
+//iostream and exactly as std::fixed with a precision of 3 prints them
+class Output {
+    
+private:
+    std::ostream &os;
+    std::vector<char> buffer;
+    size_t size = 0;
+    
+    static const size_t NUMBER_LENGTH = 32;//enough for an int or a double below 1e12
+    
+    void reserve(size_t length) {
+        if (size + length > buffer.size()) {
+            flush();
+        }
+    }
+    
+    static char *formatInteger(unsigned long long value, char *out) {
+        char digits[20];
+        size_t length = 0;
+        do {
+            digits[length++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (length != 0) {
+            *out++ = digits[--length];
+        }
+        return out;
+    }
+    
+    // format a double below 1e12 like printf's %.3f, rounding the exact value to the nearest thousandth and a tie to
+    // even. the product by 1000 is rounded, but it can only land on a tie it is not exactly, which fma tells
+    static char *formatDouble(double d, char *out) {
+        double scaled = std::fabs(d) * 1000;
+        double thousandths = std::nearbyint(scaled);
+        if (scaled - std::floor(scaled) == 0.5) {
+            double error = std::fma(std::fabs(d), 1000, -scaled);
+            if (error > 0) {
+                thousandths = std::ceil(scaled);
+            } else if (error < 0) {
+                thousandths = std::floor(scaled);
+            }
+        }
+        if (std::signbit(d)) {
+            *out++ = '-';
+        }
+        unsigned long long value = static_cast<unsigned long long>(thousandths);
+        out = formatInteger(value / 1000, out);
+        unsigned int fraction = static_cast<unsigned int>(value % 1000);
+        *out++ = '.';
+        *out++ = static_cast<char>('0' + fraction / 100);
+        *out++ = static_cast<char>('0' + fraction / 10 % 10);
+        *out++ = static_cast<char>('0' + fraction % 10);
+        return out;
+    }
+    
+public:
+    Output(std::ostream &os, size_t capacity = 1 << 20) : os(os), buffer(capacity) {}
+    
+    ~Output() {
+        flush();
+    }
+    
+    void write(const char *s, size_t length) {
+        reserve(length);
+        if (length > buffer.size()) {
+            os.write(s, static_cast<std::streamsize>(length));
+            return;
+        }
+        std::memcpy(buffer.data() + size, s, length);
+        size += length;
+    }
+    
+    Output &operator<<(const char *s) {
+        write(s, std::strlen(s));
+        return *this;
+    }
+    
+    Output &operator<<(char c) {
+        reserve(1);
+        buffer[size++] = c;
+        return *this;
+    }
+    
+    Output &operator<<(const Number &number) {
+        reserve(NUMBER_LENGTH);
+        char *begin = buffer.data() + size;
+        char *end;
+        if (number.is_int_or_double()) {
+            int i = number.getIntegerValue();
+            end = begin;
+            if (i < 0) {
+                *end++ = '-';
+            }
+            end = formatInteger(i < 0 ? 0ull - static_cast<unsigned long long>(i) : i, end);
+        } else if (std::fabs(number.getDoubleValue()) < 1e12) {
+            end = formatDouble(number.getDoubleValue(), begin);
+        } else {
+            // big ones, infinity and nan are left to printf, which iostream formats with too
+            char text[400];
+            int length = std::snprintf(text, sizeof(text), "%.3f", number.getDoubleValue());
+            write(text, static_cast<size_t>(length));
+            return *this;
+        }
+        size += static_cast<size_t>(end - begin);
+        return *this;
+    }
+    
+    void flush() {
+        if (size != 0) {
+            os.write(buffer.data(), static_cast<std::streamsize>(size));
+            size = 0;
+        }
+        os.flush();
+    }
+};
+
+const size_t BATCH_SIZE = 4096;//instructions compiled before they are run
+
+//what an instruction does
+enum class OpCode : unsigned char {
+    Push,//push the literal the operand indexes
+    Add,
+    Sub,
+    Mult,
+    Div,
+    Sqrt,
+    Pop,
+    Reverse,
+    RepeatBegin,//pop the repeat time, the operand is the instruction after the matching RepeatEnd
+    RepeatEnd,//the operand is the first instruction of the body
+    RepeatOpen,//a 'repeat' never closed: pop the repeat time, the rest of the program only runs if it is 0
+    Print,//print the step the operand indexes, what an operation folded by optimize printed
+    RepeatAdd,//a repeat of only 'c add', the operand indexes the literal c
+    RepeatMult//a repeat of only 'c mult', the operand indexes the literal c
+};
+
+struct Instruction {
+    OpCode op;
+    unsigned int operand;
+};
+
+//an operation as it is printed, an is the operand that was on the top of the stack. bn is unused by Sqrt
+struct Step {
+    OpCode op;
+    Number an;
+    Number bn;
+    Number cn;
+};
+
+//a compiled token vector, each repeat body is kept once and looped over
+struct Program {
+    std::vector<Instruction> code;
+    std::vector<Number> literals;//parsed literals the Push instructions index
+    std::vector<Step> steps;//what the Print instructions print
+};
+
+inline bool isDivisionByZero(OpCode code, const Number &an, const Number &bn) {
+    return code == OpCode::Div && an.is_int_or_double() && bn.is_int_or_double() && bn.getIntegerValue() == 0;
+}
+
+//the result of an arithmetic operation or sqrt before it is stored
+inline Number calculate(OpCode code, const Number &an, const Number &bn) {
+    bool isInteger = an.is_int_or_double() && bn.is_int_or_double();
+    if (code == OpCode::Add) {
+        if (isInteger) {
+            return Number(an.getIntegerValue() + bn.getIntegerValue());
+        }
+        return Number(an.getDoubleValue() + bn.getDoubleValue());
+    } else if (code == OpCode::Sub) {
+        if (isInteger) {
+            return Number(an.getIntegerValue() - bn.getIntegerValue());
+        }
+        return Number(an.getDoubleValue() - bn.getDoubleValue());
+    } else if (code == OpCode::Mult) {
+        if (isInteger) {
+            return Number(an.getIntegerValue() * bn.getIntegerValue());
+        }
+        return Number(an.getDoubleValue() * bn.getDoubleValue());
+    } else if (code == OpCode::Div) {
+        if (isDivisionByZero(code, an, bn)) {
+            throw std::runtime_error("Division by zero!");
+        }
+        if (isInteger) {
+            return Number(an.getIntegerValue() / bn.getIntegerValue());
+        }
+        return Number(an.getDoubleValue() / bn.getDoubleValue());
+    }
+    return Number(std::sqrt(an.getDoubleValue()));
+}
+
+template <size_t N>
+inline bool isKeyword(const char *token, size_t length, const char (&keyword)[N]) {
+    return length == N - 1 && std::memcmp(token, keyword, N - 1) == 0;
+}
+
+struct Keyword {
+    const char *text;
+    size_t length;
+    OpCode op;
+};
+
+//the keywords at (first character + length) % 32, which is different for each of them. the other slots are empty
+const Keyword KEYWORDS[32] = {
+    {}, {}, {}, {}, {"add", 3, OpCode::Add}, {}, {}, {"div", 3, OpCode::Div},
+    {}, {}, {}, {}, {}, {}, {"endrepeat", 9, OpCode::RepeatEnd}, {},
+    {}, {"mult", 4, OpCode::Mult}, {}, {"pop", 3, OpCode::Pop}, {}, {}, {"sub", 3, OpCode::Sub}, {"sqrt", 4, OpCode::Sqrt},
+    {"repeat", 6, OpCode::RepeatBegin}, {"reverse", 7, OpCode::Reverse}, {}, {}, {}, {}, {}, {}
+};
+
+//the opcode of a keyword, Push for anything else. the slot of its first character and length is the only keyword it
+//can be, so a token costs one compare
+inline OpCode toOpCode(const char *token, size_t length) {
+    const Keyword &keyword = KEYWORDS[(static_cast<unsigned char>(token[0]) + length) % 32];
+    return keyword.length == length && std::memcmp(token, keyword.text, length) == 0 ? keyword.op : OpCode::Push;
+}
+
+//turns tokens into a program as they are read, keywords are resolved here and never again. whenever no repeat is
+//open the program compiled so far can be run and cleared
+class Compiler {
+    
+private:
+    Program program;
+    std::vector<size_t> openRepeats;//RepeatBegin instructions still waiting for their 'endrepeat'
+    
+    //end the innermost open repeat
+    void closeRepeat() {
+        size_t begin = openRepeats.back();
+        openRepeats.pop_back();
+        program.code.push_back({OpCode::RepeatEnd, static_cast<unsigned int>(begin + 1)});
+        program.code[begin].operand = static_cast<unsigned int>(program.code.size());
+    }
+    
+public:
+    void add(const char *token, size_t length) {
+        OpCode op = toOpCode(token, length);
+        switch (op) {
+            case OpCode::Push:
+                try {
+                    program.literals.push_back(Number(token, length));
+                } catch (std::logic_error&) {
+                    throw std::invalid_argument("Unknown token: " + std::string(token, length));
+                }
+                program.code.push_back({OpCode::Push, static_cast<unsigned int>(program.literals.size() - 1)});
+                break;
+            case OpCode::RepeatBegin:
+                openRepeats.push_back(program.code.size());
+                program.code.push_back({OpCode::RepeatBegin, 0});
+                break;
+            case OpCode::RepeatEnd:
+                if (!openRepeats.empty()) {// unpaired 'endrepeat' is ignored
+                    closeRepeat();
+                }
+                break;
+            default:
+                program.code.push_back({op, 0});
+                break;
+        }
+    }
+    
+    bool isRunnable() const {
+        return openRepeats.empty();
+    }
+    
+    Program &getProgram() {
+        return program;
+    }
+    
+    //the rest of the program. a 'repeat' never closed keeps everything after it as its body, which is never run, as
+    //it never gets to its 'endrepeat'. only a time of 0, which does not repeat at all, lets it run on
+    Program &finish() {
+        for (size_t begin: openRepeats) {
+            program.code[begin].op = OpCode::RepeatOpen;
+        }
+        openRepeats.clear();
+        return program;
+    }
+    
+    void clear() {
+        program.code.clear();
+        program.literals.clear();
+        program.steps.clear();
+    }
+};
+
+//reads whitespace separated tokens a block at a time. a token points into the block, so it is only valid until the
+//next one is read
+class Tokenizer {
+    
+private:
+    std::istream &in;
+    std::vector<char> buffer;
+    size_t position = 0;//first character not read yet
+    size_t size = 0;//characters in the buffer
+    
+    //move what is left of the buffer to its front and read after it, false at the end of the input
+    bool refill() {
+        size_t kept = size - position;
+        std::memmove(buffer.data(), buffer.data() + position, kept);
+        position = 0;
+        size = kept;
+        if (kept == buffer.size()) {
+            buffer.resize(buffer.size() * 2);// a token longer than a block
+        }
+        if (!in) {
+            return false;
+        }
+        in.read(buffer.data() + size, buffer.size() - size);
+        size += static_cast<size_t>(in.gcount());
+        return in.gcount() > 0;
+    }
+    
+    bool isSpace(char c) {
+        return std::isspace(static_cast<unsigned char>(c));
+    }
+    
+public:
+    Tokenizer(std::istream &in, size_t blockSize = 1 << 16) : in(in), buffer(blockSize) {}
+    
+    bool next(const char *&token, size_t &length) {
+        while (true) {
+            while (position < size && isSpace(buffer[position])) {
+                position++;
+            }
+            if (position < size) {
+                break;
+            }
+            if (!refill()) {
+                return false;
+            }
+        }
+        size_t end = position;
+        while (true) {
+            while (end < size && !isSpace(buffer[end])) {
+                end++;
+            }
+            if (end < size) {
+                break;
+            }
+            // the token may go on in the next block
+            size_t tokenLength = end - position;
+            bool isRead = refill();
+            end = tokenLength;
+            if (!isRead) {
+                break;
+            }
+        }
+        token = buffer.data() + position;
+        length = end - position;
+        position = end;
+        return true;
+    }
+};
+
+//runs a program, nested repeats only cost a counter each
+class VirtualMachine {
+    
+private:
+    std::vector<Number> stack;
+    std::vector<int> repeats;//remaining times of the repeats being run, innermost last
+    Output *trace = nullptr;//where every operation is printed, if anywhere
+    
+    Number pop() {
+        if (stack.empty()) {
+            throw std::runtime_error("Not enough operands on the stack!");
+        }
+        Number n = stack.back();
+        stack.pop_back();
+        return n;
+    }
+    
+    void print(const Step &step) {
+        if (!trace) {
+            return;
+        }
+        if (step.op == OpCode::Sqrt) {
+            *trace << "sqrt " << step.an << " = " << step.cn << '\n';
+            return;
+        }
+        const char *op = step.op == OpCode::Add ? " + "
+        : step.op == OpCode::Sub ? " - "
+        : step.op == OpCode::Mult ? " * " : " / ";
+        *trace << step.an << op << step.bn << " = " << step.cn << '\n';
+    }
+    
+    //pop the operands of an arithmetic operation or sqrt, print it and push its result
+    void operate(OpCode code) {
+        Number an = pop();
+        Number bn = code == OpCode::Sqrt ? an : pop();
+        Number cn = calculate(code, an, bn);
+        print({code, an, bn, cn});
+        stack.push_back(cn.toStored());
+    }
+    
+    //run a repeat of only 'c add' or 'c mult'. while the top and c are integers the result is worked out at once, as
+    //they are never negative it is exact unless it overflows, which is left to the loop
+    void repeatOperation(OpCode code, const Number &c) {
+        int repeat = pop().getIntegerValue();
+        long long times = repeat < 0 ? 0 : std::max(repeat, 1);
+        if (!stack.empty() && stack.back().is_int_or_double() && c.is_int_or_double()) {
+            long long result = stack.back().getIntegerValue();
+            long long factor = c.getIntegerValue();
+            if (code == OpCode::Add) {
+                result += times * factor;
+            } else {
+                const long long MAX = std::numeric_limits<int>::max();
+                for (long long k = 0; k < times && result != 0 && factor != 1 && result <= MAX; k++) {
+                    result *= factor;
+                }
+            }
+            if (result >= 0 && result <= std::numeric_limits<int>::max()) {
+                stack.back() = Number(static_cast<int>(result));
+                return;
+            }
+        }
+        for (long long k = 0; k < times; k++) {
+            stack.push_back(c);
+            operate(code);
+        }
+    }
+    
+public:
+    void setTrace(Output *trace) {
+        this->trace = trace;
+    }
+    
+    bool isTraced() const {
+        return trace != nullptr;
+    }
+    
+    const std::vector<Number> &getStack() const {
+        return stack;
+    }
+    
+    void run(const Program& program) {
+        size_t pc = 0;
+        while (pc < program.code.size()) {
+            const Instruction& instruction = program.code[pc++];
+            switch (instruction.op) {
+                case OpCode::Push:
+                    stack.push_back(program.literals[instruction.operand]);
+                    break;
+                case OpCode::Add:
+                case OpCode::Sub:
+                case OpCode::Mult:
+                case OpCode::Div:
+                case OpCode::Sqrt:
+                    operate(instruction.op);
+                    break;
+                case OpCode::Pop:
+                    pop();
+                    break;
+                case OpCode::Reverse: {
+                    pop();
+                    if (stack.empty()) {
+                        throw std::runtime_error("Not enough operands on the stack!");
+                    }
+                    
+                    // reverse next n (n is the value at the top of current stack) elements
+                    size_t n = static_cast<size_t>(std::max(stack.back().getIntegerValue(), 0));
+                    std::reverse(stack.end() - std::min(n, stack.size()), stack.end());
+                    break;
+                }
+                case OpCode::RepeatBegin: {
+                    int repeat = pop().getIntegerValue();
+                    if (repeat < 0) {
+                        pc = instruction.operand;// skip the body
+                    } else {
+                        repeats.push_back(repeat == 0 ? 1 : repeat);// a body repeated 0 times is still run once
+                    }
+                    break;
+                }
+                case OpCode::RepeatOpen:
+                    if (pop().getIntegerValue() != 0) {
+                        pc = program.code.size();
+                    }
+                    break;
+                case OpCode::RepeatEnd:
+                    if (--repeats.back() > 0) {
+                        pc = instruction.operand;
+                    } else {
+                        repeats.pop_back();
+                    }
+                    break;
+                case OpCode::Print:
+                    print(program.steps[instruction.operand]);
+                    break;
+                case OpCode::RepeatAdd:
+                    repeatOperation(OpCode::Add, program.literals[instruction.operand]);
+                    break;
+                case OpCode::RepeatMult:
+                    repeatOperation(OpCode::Mult, program.literals[instruction.operand]);
+                    break;
+            }
+        }
+    }
+};
+
+//rewrite a compiled program to do less while printing the same:
+// - an operation on literals pushed in the same block is worked out here, a Print instruction keeps its line
+// - a repeat of only 'c add' or 'c mult' with an integer c becomes a RepeatAdd or RepeatMult, if nothing is printed
+// - a literal popped right after it is pushed is dropped, and a repeat left with nothing to run
+//a block ends at each RepeatBegin, RepeatEnd and RepeatOpen, as a jump can enter there or the rest may not run
+inline void optimize(Program &program, bool isTraced) {
+    const size_t NONE = std::numeric_limits<size_t>::max();
+    std::vector<Instruction> code;
+    code.reserve(program.code.size());
+    std::vector<size_t> openRepeats;
+    size_t blockBegin = 0;
+    
+    //the Push of the block the value below the end of code comes from, skipping Prints as they leave the stack alone
+    auto findPush = [&](size_t end) {
+        while (end > blockBegin) {
+            --end;
+            if (code[end].op != OpCode::Print) {
+                return code[end].op == OpCode::Push ? end : NONE;
+            }
+        }
+        return NONE;
+    };
+    
+    for (auto const& instruction: program.code) {
+        switch (instruction.op) {
+            case OpCode::Add:
+            case OpCode::Sub:
+            case OpCode::Mult:
+            case OpCode::Div:
+            case OpCode::Sqrt: {
+                size_t a = findPush(code.size());
+                size_t b = a == NONE || instruction.op == OpCode::Sqrt ? a : findPush(a);
+                if (b == NONE) {
+                    code.push_back(instruction);
+                    break;
+                }
+                Number an = program.literals[code[a].operand];
+                Number bn = program.literals[code[b].operand];
+                if (isDivisionByZero(instruction.op, an, bn)) {
+                    code.push_back(instruction);// it throws when it runs, after what comes before it is printed
+                    break;
+                }
+                Number cn = calculate(instruction.op, an, bn);
+                code.erase(code.begin() + a);
+                if (b != a) {
+                    code.erase(code.begin() + b);
+                }
+                if (isTraced) {
+                    program.steps.push_back({instruction.op, an, bn, cn});
+                    code.push_back({OpCode::Print, static_cast<unsigned int>(program.steps.size() - 1)});
+                }
+                program.literals.push_back(cn.toStored());
+                code.push_back({OpCode::Push, static_cast<unsigned int>(program.literals.size() - 1)});
+                break;
+            }
+            case OpCode::Pop: {
+                size_t a = findPush(code.size());
+                if (a == NONE) {
+                    code.push_back(instruction);
+                } else {
+                    code.erase(code.begin() + a);
+                }
+                break;
+            }
+            case OpCode::RepeatBegin:
+                openRepeats.push_back(code.size());
+                code.push_back(instruction);
+                blockBegin = code.size();
+                break;
+            case OpCode::RepeatOpen:
+                code.push_back(instruction);
+                blockBegin = code.size();
+                break;
+            case OpCode::RepeatEnd: {
+                size_t begin = openRepeats.back();
+                openRepeats.pop_back();
+                bool isCollapsed = !isTraced && code.size() == begin + 3
+                && code[begin + 1].op == OpCode::Push && program.literals[code[begin + 1].operand].is_int_or_double()
+                && (code[begin + 2].op == OpCode::Add || code[begin + 2].op == OpCode::Mult);
+                if (code.size() == begin + 1) {
+                    code[begin] = {OpCode::Pop, 0};// nothing left to repeat, only its time is popped
+                } else if (isCollapsed) {
+                    OpCode op = code[begin + 2].op == OpCode::Add ? OpCode::RepeatAdd : OpCode::RepeatMult;
+                    Instruction collapsed = {op, code[begin + 1].operand};
+                    code.resize(begin);
+                    code.push_back(collapsed);
+                } else {
+                    code.push_back({OpCode::RepeatEnd, static_cast<unsigned int>(begin + 1)});
+                    code[begin].operand = static_cast<unsigned int>(code.size());
+                }
+                blockBegin = code.size();
+                break;
+            }
+            default:
+                code.push_back(instruction);
+                break;
+        }
+    }
+    program.code.swap(code);
+}
+
+//compile the tokens of in while reading them, and run what is compiled every batch
+inline void runScript(std::istream &in, VirtualMachine &vm, bool isOptimized = true) {
+    Tokenizer tokenizer(in);
+    Compiler compiler;
+    auto run = [&](Program &program) {
+        if (isOptimized) {
+            optimize(program, vm.isTraced());
+        }
+        vm.run(program);
+    };
+    const char *token;
+    size_t length;
+    while (tokenizer.next(token, length)) {
+        compiler.add(token, length);
+        if (compiler.isRunnable() && compiler.getProgram().code.size() >= BATCH_SIZE) {
+            run(compiler.getProgram());
+            compiler.clear();
+        }
+    }
+    run(compiler.finish());
+}
+
+#endif /* Calculator_h */
@@ -0,0 +1,363 @@
+//
+//  main.cpp
+//  Benchmark
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+//  benchmark driver for the ParallelBucketSort engines, build it with
+//  g++ -std=c++14 -O2 -pthread -I../ParallelBucketSort main.cpp ../ParallelBucketSort/ThreadPool.cpp ../ParallelBucketSort/SortStats.cpp ../ParallelBucketSort/SortHandle.cpp ../ParallelBucketSort/SimdSort.cpp -o Benchmark
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BucketSorter.h"
+
+namespace
+{
+    struct Options
+    {
+        size_t size = 10000000;
+        std::string distribution = "uniform";
+        std::vector<unsigned> cores;
+        std::string engine = "bucket";
+        unsigned repeat = 3;
+        unsigned seed = 1;
+        bool verify = true;
+        bool json = false;
+        bool pin = false;
+    };
+
+    const size_t ZIPF_VALUES = 100000; //distinct values of the zipf distribution
+    const double ZIPF_EXPONENT = 1.0;
+    const unsigned NARROW_BEGIN = 1000000; //the narrow distribution is [NARROW_BEGIN, NARROW_BEGIN + NARROW_WIDTH)
+    const unsigned NARROW_WIDTH = 1000;
+
+    void printUsage()
+    {
+        std::cout << "usage: Benchmark [options]\n"
+                  << "  --size N            numbers to sort, 10000000 by default\n"
+                  << "  --distribution D    uniform, zipf, sorted, reverse, equal or narrow\n"
+                  << "  --cores C[,C...]    cores to sort with, a list runs each in turn to show scaling\n"
+                  << "  --engine E          bucket, radix, inplace or sample\n"
+                  << "  --repeat R          sorts per core count, 3 by default\n"
+                  << "  --seed S            seed of the generator, 1 by default\n"
+                  << "  --no-verify         skip the check against std::sort\n"
+                  << "  --pin               pin the workers to cores and sort in affinity mode\n"
+                  << "  --json              print the full stats of every run as a line of JSON" << std::endl;
+    }
+
+    std::vector<unsigned> parseCores(const std::string &list)
+    {
+        std::vector<unsigned> cores;
+        std::istringstream in(list);
+        std::string item;
+        while (std::getline(in, item, ','))
+        {
+            cores.push_back(static_cast<unsigned>(std::stoul(item)));
+            if (cores.back() == 0)
+            {
+                throw std::invalid_argument("cores must be at least 1");
+            }
+        }
+        return cores;
+    }
+
+    Options parseOptions(int argc, const char *argv[])
+    {
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string name = argv[i];
+            if (name == "--no-verify")
+            {
+                options.verify = false;
+                continue;
+            }
+            if (name == "--json")
+            {
+                options.json = true;
+                continue;
+            }
+            if (name == "--pin")
+            {
+                options.pin = true;
+                continue;
+            }
+            if (i + 1 == argc)
+            {
+                throw std::invalid_argument("missing value of " + name);
+            }
+            std::string value = argv[++i];
+            if (name == "--size")
+            {
+                options.size = std::stoull(value);
+            }
+            else if (name == "--distribution")
+            {
+                options.distribution = value;
+            }
+            else if (name == "--cores")
+            {
+                options.cores = parseCores(value);
+            }
+            else if (name == "--engine")
+            {
+                options.engine = value;
+            }
+            else if (name == "--repeat")
+            {
+                options.repeat = static_cast<unsigned>(std::stoul(value));
+                if (options.repeat == 0)
+                {
+                    throw std::invalid_argument("repeat must be at least 1");
+                }
+            }
+            else if (name == "--seed")
+            {
+                options.seed = static_cast<unsigned>(std::stoul(value));
+            }
+            else
+            {
+                throw std::invalid_argument("unknown option " + name);
+            }
+        }
+        if (options.cores.empty())
+        {
+            options.cores.push_back(std::max(std::thread::hardware_concurrency(), 1u));
+        }
+        return options;
+    }
+
+    SortEngine toEngine(const std::string &name)
+    {
+        if (name == "bucket")
+        {
+            return SortEngine::Bucket;
+        }
+        if (name == "radix")
+        {
+            return SortEngine::Radix;
+        }
+        if (name == "inplace")
+        {
+            return SortEngine::InPlace;
+        }
+        if (name == "sample")
+        {
+            return SortEngine::Sample;
+        }
+        throw std::invalid_argument("unknown engine " + name);
+    }
+
+    std::vector<unsigned> makeNumbers(const Options &options)
+    {
+        std::mt19937 mt(options.seed);
+        std::uniform_int_distribution<unsigned> uniform(0, std::numeric_limits<unsigned>::max());
+        std::vector<unsigned> numbers(options.size);
+
+        if (options.distribution == "uniform" || options.distribution == "sorted" || options.distribution == "reverse")
+        {
+            for (auto &number : numbers)
+            {
+                number = uniform(mt);
+            }
+            if (options.distribution != "uniform")
+            {
+                std::sort(numbers.begin(), numbers.end(), LexicographicKey<unsigned>::less);
+            }
+            if (options.distribution == "reverse")
+            {
+                std::reverse(numbers.begin(), numbers.end());
+            }
+        }
+        else if (options.distribution == "zipf")
+        {
+            // value i of ZIPF_VALUES random ones is drawn with a weight of 1 / (i + 1)^ZIPF_EXPONENT
+            std::vector<unsigned> values(ZIPF_VALUES);
+            std::vector<double> cumulative(ZIPF_VALUES);
+            double sum = 0;
+            for (size_t i = 0; i < ZIPF_VALUES; ++i)
+            {
+                values[i] = uniform(mt);
+                sum += 1 / std::pow(i + 1.0, ZIPF_EXPONENT);
+                cumulative[i] = sum;
+            }
+            std::uniform_real_distribution<double> real(0, sum);
+            for (auto &number : numbers)
+            {
+                size_t i = std::upper_bound(cumulative.begin(), cumulative.end(), real(mt)) - cumulative.begin();
+                number = values[std::min(i, ZIPF_VALUES - 1)];
+            }
+        }
+        else if (options.distribution == "equal")
+        {
+            std::fill(numbers.begin(), numbers.end(), uniform(mt));
+        }
+        else if (options.distribution == "narrow")
+        {
+            std::uniform_int_distribution<unsigned> narrow(NARROW_BEGIN, NARROW_BEGIN + NARROW_WIDTH - 1);
+            for (auto &number : numbers)
+            {
+                number = narrow(mt);
+            }
+        }
+        else
+        {
+            throw std::invalid_argument("unknown distribution " + options.distribution);
+        }
+        return numbers;
+    }
+
+    /**
+     *the comparator BucketSort sorted with before it had keys, kept as the reference the engines are checked against
+     */
+    bool aLessB(const unsigned int &x, const unsigned int &y, unsigned int pow)
+    {
+        if (x == y)
+        {
+            return false; // if the two numbers are the same then one is not less than the other
+        }
+        unsigned int a = x;
+        unsigned int b = y;
+        // work out the digit we are currently comparing on.
+        if (pow == 0)
+        {
+            while (a / 10 > 0)
+            {
+                a = a / 10;
+            }
+            while (b / 10 > 0)
+            {
+                b = b / 10;
+            }
+        }
+        else
+        {
+            while (a / 10 >= (unsigned int)std::round(std::pow(10, pow)))
+            {
+                a = a / 10;
+            }
+            while (b / 10 >= (unsigned int)std::round(std::pow(10, pow)))
+            {
+                b = b / 10;
+            }
+        }
+
+        if (a == b)
+            return aLessB(x, y, pow + 1); // recurse if this digit is the same
+        else
+            return a < b;
+    }
+
+    double getMedian(std::vector<double> values)
+    {
+        std::sort(values.begin(), values.end());
+        size_t middle = values.size() / 2;
+        return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    Options options;
+    SortEngine engine;
+    std::vector<unsigned> numbers;
+    try
+    {
+        options = parseOptions(argc, argv);
+        engine = toEngine(options.engine);
+        numbers = makeNumbers(options);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        printUsage();
+        return 2;
+    }
+
+    std::vector<unsigned> expected;
+    if (options.verify)
+    {
+        expected = numbers;
+        std::sort(expected.begin(), expected.end(), [](const unsigned &x, const unsigned &y) {
+            return aLessB(x, y, 0);
+        });
+    }
+
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "size " << options.size << ", distribution " << options.distribution << ", engine " << options.engine << (options.pin ? ", pinned" : "") << std::endl;
+
+    bool isCorrect = true;
+    double baseSeconds = 0; // median wall time of the first core count, to compute the speedup of the others
+    for (unsigned cores : options.cores)
+    {
+        ThreadPool pool{cores - 1, options.pin}; // main thread + pool threads = cores
+        BucketSorter<unsigned> sorter(pool, engine);
+        SortStats stats;
+        sorter.setStats(&stats);
+        sorter.setAffinity(options.pin);
+
+        std::vector<double> seconds;
+        for (unsigned run = 1; run <= options.repeat; ++run)
+        {
+            std::vector<unsigned> sorted = numbers;
+            stats.clear();
+
+            auto start = std::chrono::steady_clock::now();
+            sorter.sort(sorted.data(), sorted.data() + sorted.size());
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            seconds.push_back(elapsed.count());
+
+            std::cout << "cores " << cores << " run " << run << ": " << elapsed.count() << " s, "
+                      << options.size / elapsed.count() / 1e6 << " M numbers/s |";
+            for (auto &phase : stats.phaseSeconds)
+            {
+                std::cout << " " << phase.first << " " << phase.second;
+            }
+            std::cout << " | idle " << stats.getIdleSeconds() << " s, imbalance " << stats.getImbalance() << ", "
+                      << stats.bytesMoved / 1e6 << " MB moved | cpu/node";
+            for (unsigned w = 0; w < stats.workerNum; ++w)
+            {
+                std::cout << " " << stats.workerCpus[w] << "/" << stats.workerNodes[w];
+            }
+            std::cout << std::endl;
+            if (options.json)
+            {
+                stats.writeJson(std::cout);
+                std::cout << std::endl;
+            }
+
+            if (options.verify && sorted != expected)
+            {
+                std::cout << "cores " << cores << " run " << run << ": WRONG ORDER" << std::endl;
+                isCorrect = false;
+            }
+        }
+
+        double median = getMedian(seconds);
+        if (baseSeconds == 0)
+        {
+            baseSeconds = median * options.cores.front();
+        }
+        std::cout << "cores " << cores << ": best " << *std::min_element(seconds.begin(), seconds.end()) << " s, median " << median
+                  << " s, parallel efficiency " << baseSeconds / median / cores << std::endl;
+    }
+
+    if (options.verify)
+    {
+        std::cout << (isCorrect ? "verified against std::sort" : "verification FAILED") << std::endl;
+    }
+    return isCorrect ? 0 : 1;
+}
@@ -7,170 +7,57 @@
 //
 
 #include "BucketSort.h"
-#include <cmath>
-#include <thread>
-#include <algorithm>
+#include <string>
 
-struct BucketTask
+void BucketSort::sort(unsigned int numCores, Engine engine, bool hasAffinity)
 {
-    unsigned bucketIndex;
-    std::vector<unsigned> numbersInBucket;
-
-    bool isRunning;
-    bool isDone;
-
-    BucketTask() {}
-
-    BucketTask(unsigned bucketIndex)
-    {
-        this->bucketIndex = bucketIndex;
-        isRunning = false;
-        isDone = false;
-    }
-
-    void run(std::vector<unsigned int> &numbersToSort)
-    {
-        isRunning = true;
-        isDone = false;
-
-        for (auto a : numbersToSort)
-        {
-            unsigned bits = getBits(a); // get the bits of each number
-            unsigned firstNum = a / std::pow(10, bits - 1);
-            if (firstNum == bucketIndex)
-            {
-                numbersInBucket.push_back(a);
-            }
-        }
-
-        // in each bucket, do the sort
-        std::sort(numbersInBucket.begin(), numbersInBucket.end(), [this](const unsigned &x, const unsigned &y) {
-            return aLessB(x, y, 0);
-        });
-
-        isRunning = false;
-        isDone = true;
-    }
+    ThreadPool pool{std::max(numCores, 1u) - 1, hasAffinity}; // main thread + pool threads = numCores
+    BucketSorter<unsigned int> sorter(pool, engine);
+    sorter.setAffinity(hasAffinity);
+    sorter.sort(numbersToSort.data(), numbersToSort.data() + numbersToSort.size());
+}
 
-    /**
-     *return the bits of i, e.g. i = 1000, then return 4
-     */
-    unsigned getBits(unsigned i)
-    {
-        unsigned bits = 1; //at least, 1 bit
-        unsigned tempMaxValue = i;
-        while (tempMaxValue >= 10)
-        {
-            ++bits;
-            tempMaxValue /= 10;
-        }
-        return bits;
-    }
+void BucketSort::sort(ThreadPool &pool, Engine engine)
+{
+    BucketSorter<unsigned int>(pool, engine).sort(numbersToSort.data(), numbersToSort.data() + numbersToSort.size());
+}
 
-    bool aLessB(const unsigned int &x, const unsigned int &y, unsigned int pow)
-    {
-        if (x == y)
-        {
-            return false; // if the two numbers are the same then one is not less than the other
-        }
-        unsigned int a = x;
-        unsigned int b = y;
-        // work out the digit we are currently comparing on.
-        if (pow == 0)
-        {
-            while (a / 10 > 0)
-            {
-                a = a / 10;
-            }
-            while (b / 10 > 0)
-            {
-                b = b / 10;
-            }
-        }
-        else
-        {
-            while (a / 10 >= (unsigned int)std::round(std::pow(10, pow)))
-            {
-                a = a / 10;
-            }
-            while (b / 10 >= (unsigned int)std::round(std::pow(10, pow)))
-            {
-                b = b / 10;
-            }
-        }
+SortHandle BucketSort::sortAsync(ThreadPool &pool, Engine engine)
+{
+    return BucketSorter<unsigned int>(pool, engine).sortAsync(numbersToSort.data(), numbersToSort.data() + numbersToSort.size());
+}
 
-        if (a == b)
-            return aLessB(x, y, pow + 1); // recurse if this digit is the same
-        else
-            return a < b;
-    }
+std::vector<size_t> BucketSort::argsort(ThreadPool &pool, Engine engine) const
+{
+    return BucketSorter<unsigned int>(pool, engine).argsort(numbersToSort.data(), numbersToSort.data() + numbersToSort.size());
+}
 
-    void move2MainBucket(std::vector<unsigned int> &numbersToSort)
-    {
-        for (auto a : numbersInBucket)
-        {
-            numbersToSort.push_back(a);
-        }
-        numbersInBucket.clear();
-        isRunning = false;
-        isDone = false;
-    }
-};
+void BucketSort::sortUnique(ThreadPool &pool, Engine engine)
+{
+    unsigned int *first = numbersToSort.data();
+    unsigned int *last = BucketSorter<unsigned int>(pool, engine).sortUnique(first, first + numbersToSort.size());
+    numbersToSort.resize(last - first);
+    numbersToSort.shrink_to_fit();
+}
 
-void BucketSort::sort(unsigned int numCores)
+std::vector<std::pair<unsigned int, size_t>> BucketSort::sortCounted(ThreadPool &pool, Engine engine) const
 {
-    const unsigned BUCKET_NUM = 9; //for MSD (Most Significant Digit) 1~9
-    BucketTask BUCKETS[BUCKET_NUM];
-    const unsigned TASK_NUM = numCores - 1; // main thread + task threads = numCores
+    return BucketSorter<unsigned int>(pool, engine).sortCounted(numbersToSort.data(), numbersToSort.data() + numbersToSort.size());
+}
 
-    // init 9 buckets
-    for (unsigned i = 0; i < BUCKET_NUM; ++i)
-    {
-        BUCKETS[i] = BucketTask{i + 1};
-    }
+void BucketSort::partialSort(ThreadPool &pool, size_t k)
+{
+    unsigned int *first = numbersToSort.data();
+    BucketSorter<unsigned int>(pool).partialSort(first, first + std::min(k, numbersToSort.size()), first + numbersToSort.size());
+}
 
-    // main loop, to manage task threads
-    while (true)
+unsigned int BucketSort::nth(ThreadPool &pool, size_t rank)
+{
+    if (rank >= numbersToSort.size())
     {
-        unsigned isRunningNum = 0;
-        unsigned isDoneNum = 0;
-
-        for (unsigned i = 0; i < BUCKET_NUM; ++i)
-        {
-            if (BUCKETS[i].isRunning)
-            {
-                ++isRunningNum;
-            }
-
-            if (BUCKETS[i].isDone)
-            {
-                ++isDoneNum;
-            }
-        }
-
-        if (isRunningNum < TASK_NUM) // can run more thread
-        {
-            unsigned validThreadNum = TASK_NUM - isRunningNum;
-            if (isDoneNum < BUCKET_NUM) // some buckets are still waiting to start
-            {
-                for (unsigned i = 0; i < BUCKET_NUM; ++i)
-                {
-                    if (!BUCKETS[i].isRunning && !BUCKETS[i].isDone && validThreadNum > 0)
-                    {
-                        std::thread{&BucketTask::run, &BUCKETS[i], std::ref(numbersToSort)}.detach(); // to send the references of BUCKETS and numbersToSort to the space of new thread; make the thread run independently
-                        --validThreadNum;
-                    }
-                }
-            }
-            else // all done
-            {
-                numbersToSort.clear(); // clear main bucket
-                for (unsigned i = 0; i < BUCKET_NUM; ++i)
-                {
-                    BUCKETS[i].move2MainBucket(numbersToSort);
-                }
-                break;
-            }
-        }
+        throw std::out_of_range("BucketSort::nth rank " + std::to_string(rank) + " of " + std::to_string(numbersToSort.size()) + " numbers");
     }
+    unsigned int *first = numbersToSort.data();
+    BucketSorter<unsigned int>(pool).nthElement(first, first + rank, first + numbersToSort.size());
+    return numbersToSort[rank];
 }
@@ -9,14 +9,58 @@
 #ifndef BucketSort_h
 #define BucketSort_h
 
+#include "BucketSorter.h"
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
+// sorts numbersToSort in the lexicographic order of their decimal strings, see BucketSorter for other types
 struct BucketSort
 {
+    // how sort() orders the numbers, all of them give exactly the same result
+    typedef SortEngine Engine;
+
     // vector of numbers
     std::vector<unsigned int> numbersToSort;
 
-    void sort(unsigned int numCores);
+    // with hasAffinity, the threads are pinned to cores and sort in affinity mode, see BucketSorter::setAffinity
+    void sort(unsigned int numCores, Engine engine = Engine::Bucket, bool hasAffinity = false);
+
+    // sort with the workers of a pool that outlives this call, the calling thread joins in
+    void sort(ThreadPool &pool, Engine engine = Engine::Bucket);
+
+    /**
+     *sort in the background on a pool shared with other work and return at once, e.g. to keep a thread that handles
+     *requests responsive. numbersToSort must be left alone until the handle's wait() returns, after a cancelled
+     *sort it holds the same numbers in no particular order
+     */
+    SortHandle sortAsync(ThreadPool &pool, Engine engine = Engine::Bucket);
+
+    // sort, and move payloads[i] wherever numbersToSort[i] goes, e.g. the record IDs of the numbers
+    template <typename Payload>
+    void sort(ThreadPool &pool, std::vector<Payload> &payloads, Engine engine = Engine::Bucket)
+    {
+        if (payloads.size() != numbersToSort.size())
+        {
+            throw std::invalid_argument("BucketSort needs one payload per number");
+        }
+        BucketSorter<unsigned int>(pool, engine).sort(numbersToSort.data(), numbersToSort.data() + numbersToSort.size(), payloads.data());
+    }
+
+    // the indexes of numbersToSort in sorted order, numbersToSort is left as it is
+    std::vector<size_t> argsort(ThreadPool &pool, Engine engine = Engine::Bucket) const;
+
+    // sort and drop the duplicates, numbersToSort shrinks to the distinct numbers
+    void sortUnique(ThreadPool &pool, Engine engine = Engine::Bucket);
+
+    // the distinct numbers in order with how often each occurs, numbersToSort is left as it is
+    std::vector<std::pair<unsigned int, size_t>> sortCounted(ThreadPool &pool, Engine engine = Engine::Bucket) const;
+
+    // sort only the first k numbers into place, the rest are left in no particular order
+    void partialSort(ThreadPool &pool, size_t k);
+
+    // the number that would be at rank if they were sorted, numbersToSort is rearranged as by std::nth_element
+    unsigned int nth(ThreadPool &pool, size_t rank);
 };
 
 #endif /* BucketSort_h */
@@ -0,0 +1,1626 @@
+//
+//  BucketSorter.h
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#ifndef BucketSorter_h
+#define BucketSorter_h
+
+#include "SimdSort.h"
+#include "SortHandle.h"
+#include "SortKeys.h"
+#include "SortStats.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <utility>
+#include <vector>
+
+// how a sort orders the values
+enum class SortEngine
+{
+    Bucket,  // MSD buckets by key prefixes, then a comparison sort inside each bucket
+    Radix,   // parallel LSD radix sort over the whole keys, needs exact keys and falls back to Bucket otherwise
+    InPlace, // as Bucket, but the buckets are permuted in place, O(buckets * cores) extra memory instead of O(n)
+    Sample   // one bucket per core between splitters drawn from a random sample, balanced whatever the distribution
+};
+
+namespace bucketsort_detail
+{
+    const size_t MIN_TASK_SIZE = 1 << 14; //smaller ranges are not worth splitting into sub-tasks
+    const size_t SAMPLE_SIZE = 1 << 12;   //values looked at to choose the number of buckets
+    const unsigned RADIX_BITS = 8;        //the LSD radix sort goes through a key 8 bits at a time
+    const unsigned RADIX = 1 << RADIX_BITS;
+    const unsigned SCATTER_BLOCK = 8;     //keys a radix pass gathers per digit before writing, one cache line
+    const size_t SAMPLES_PER_SPLITTER = 128; //oversampling of the sample sort, keeps every bucket close to n / cores
+    const unsigned SELECT_FAN_OUT = 64;      //buckets a parallel selection round cuts a range into
+
+    inline size_t getSliceBegin(size_t total, unsigned workerNum, unsigned w)
+    {
+        return total * w / workerNum;
+    }
+
+    // run job(w), and add its time to (*workerSeconds)[w] if workerSeconds is not null
+    template <typename Job>
+    void runTimed(const Job &job, unsigned w, std::vector<double> *workerSeconds)
+    {
+        if (!workerSeconds)
+        {
+            job(w);
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        job(w);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        (*workerSeconds)[w] += elapsed.count();
+    }
+
+    /**
+     *run job(0) ~ job(workerNum - 1) on the pool in parallel, and wait for all of them. with workerSeconds, the
+     *time of job(w) is added to (*workerSeconds)[w]
+     */
+    template <typename Job>
+    void runOnWorkers(ThreadPool &pool, unsigned workerNum, const Job &job, std::vector<double> *workerSeconds = nullptr)
+    {
+        TaskGroup group(pool);
+        for (unsigned w = 0; w < workerNum; ++w)
+        {
+            group.run([&job, w, workerSeconds] {
+                runTimed(job, w, workerSeconds);
+            });
+        }
+        group.wait();
+    }
+
+    /**
+     *as runOnWorkers with one job per worker and the calling thread, but job(w) runs on worker w of the pool
+     *itself and the last job on the calling thread, so that a job always runs where the same job ran before
+     */
+    template <typename Job>
+    void runOnEachWorker(ThreadPool &pool, const Job &job, std::vector<double> *workerSeconds = nullptr)
+    {
+        const unsigned poolWorkerNum = pool.getWorkerNum();
+        TaskGroup group(pool);
+        for (unsigned w = 0; w < poolWorkerNum; ++w)
+        {
+            group.runOn(w, [&job, w, workerSeconds] {
+                runTimed(job, w, workerSeconds);
+            });
+        }
+        runTimed(job, poolWorkerNum, workerSeconds);
+        group.wait();
+    }
+
+    // where the workers of a partition add their times, if anywhere
+    inline std::vector<double> *getPartitionSeconds(SortStats *stats)
+    {
+        return stats ? &stats->workerPartitionSeconds : nullptr;
+    }
+
+    /**
+     *note in stats, if any, where the calling thread is running, under its own worker of the pool rather than the
+     *job it runs, which may have been stolen from another. -1 if it is not pinned, as it may move
+     */
+    inline void recordPlacement(SortStats *stats, const ThreadPool &pool)
+    {
+        if (stats)
+        {
+            const unsigned w = pool.getCurrentWorker();
+            const bool isPinned = pool.getPinnedCpu() >= 0;
+            stats->workerCpus[w] = isPinned ? ThreadPool::getCurrentCpu() : -1;
+            stats->workerNodes[w] = isPinned ? ThreadPool::getCurrentNode() : -1;
+        }
+    }
+
+    /**
+     *what is moved around while sorting. when the values can be decoded from their keys, that is only the keys,
+     *which then compare as plain integers
+     */
+    template <typename T, typename KeyTraits, bool isDecodable = KeyTraits::isDecodable>
+    struct SortItems
+    {
+        typedef typename KeyTraits::key_type key_type;
+        typedef key_type item_type;
+
+        static item_type toItem(T &value)
+        {
+            return KeyTraits::toKey(value);
+        }
+
+        static void toValue(item_type &item, T &value)
+        {
+            value = KeyTraits::fromKey(item);
+        }
+
+        static key_type getKey(const item_type &item)
+        {
+            return item;
+        }
+
+        static bool less(const item_type &a, const item_type &b)
+        {
+            return a < b;
+        }
+    };
+
+    // otherwise the values themselves are moved into the buckets and back
+    template <typename T, typename KeyTraits>
+    struct SortItems<T, KeyTraits, false>
+    {
+        typedef typename KeyTraits::key_type key_type;
+        typedef T item_type;
+
+        static T &&toItem(T &value)
+        {
+            return std::move(value);
+        }
+
+        static void toValue(item_type &item, T &value)
+        {
+            value = std::move(item);
+        }
+
+        static key_type getKey(const item_type &item)
+        {
+            return KeyTraits::toKey(item);
+        }
+
+        static bool less(const item_type &a, const item_type &b)
+        {
+            key_type keyA = KeyTraits::toKey(a);
+            key_type keyB = KeyTraits::toKey(b);
+            if (keyA != keyB || KeyTraits::isExact)
+            {
+                return keyA < keyB;
+            }
+            return KeyTraits::less(a, b);
+        }
+    };
+
+    /**
+     *a payload moving along with the items of Items, e.g. a record ID sorted by its number or the index of a value
+     *for argsort. pairs are always sorted in place, toValue is only there for BucketTask
+     */
+    template <typename Items, typename Payload>
+    struct PayloadItems
+    {
+        typedef typename Items::key_type key_type;
+        typedef std::pair<typename Items::item_type, Payload> item_type;
+
+        static void toValue(item_type &item, item_type &value)
+        {
+            value = std::move(item);
+        }
+
+        static key_type getKey(const item_type &item)
+        {
+            return Items::getKey(item.first);
+        }
+
+        static bool less(const item_type &a, const item_type &b)
+        {
+            return Items::less(a.first, b.first);
+        }
+    };
+
+    /**
+     *sorts a leaf range of items. plain keys up to SIMD_SORT_MAX_SIZE go to the vectorized sortKeys, anything else
+     *to std::sort
+     */
+    template <typename Items>
+    struct LeafSorter
+    {
+        static void sort(typename Items::item_type *first, typename Items::item_type *last)
+        {
+            std::sort(first, last, Items::less);
+        }
+    };
+
+    template <typename T, typename KeyTraits>
+    struct LeafSorter<SortItems<T, KeyTraits, true>>
+    {
+        static void sort(typename KeyTraits::key_type *first, typename KeyTraits::key_type *last)
+        {
+            if (static_cast<size_t>(last - first) <= SIMD_SORT_MAX_SIZE)
+            {
+                sortKeys(first, last);
+                return;
+            }
+            std::sort(first, last);
+        }
+    };
+
+    /**
+     *choose how many prefix levels to bucket by, from an evenly spaced sample of the values. take the fewest
+     *levels with which no bucket is expected to hold more than one worker's share, and stop early once more
+     *levels no longer shrink the biggest bucket (e.g. when most values are equal)
+     */
+    template <typename T, typename KeyTraits>
+    unsigned choosePrefixLength(const T *values, size_t total, unsigned workerNum)
+    {
+        const unsigned maxLength = KeyTraits::MAX_PREFIX_LENGTH;
+        if (workerNum == 1 || total < MIN_TASK_SIZE)
+        {
+            return 1;
+        }
+
+        const size_t sampleSize = std::min(total, SAMPLE_SIZE);
+        std::vector<typename KeyTraits::key_type> sample(sampleSize);
+        for (size_t i = 0; i < sampleSize; ++i)
+        {
+            sample[i] = KeyTraits::toKey(values[total / sampleSize * i]);
+        }
+
+        size_t lastLargest = sampleSize + 1;
+        for (unsigned length = 1; length <= maxLength; ++length)
+        {
+            std::vector<size_t> counts(KeyTraits::getPrefixNum(length), 0);
+            for (auto key : sample)
+            {
+                ++counts[KeyTraits::getPrefix(key, length)];
+            }
+            size_t largest = *std::max_element(counts.begin(), counts.end());
+            if (largest * workerNum <= sampleSize)
+            {
+                return length;
+            }
+            if (largest == lastLargest)
+            {
+                return length - 1;
+            }
+            lastLargest = largest;
+        }
+        return maxLength;
+    }
+
+    /*
+     *a classifier tells partition which bucket a key goes to. it provides
+     *
+     *  getBucketNum()      the number of buckets, they are in key order
+     *  operator()(key)     the bucket of a key
+     *  isSorted(bucket)    whether a bucket is in order as soon as it is filled, so sortBuckets can skip it
+     */
+
+    // buckets by the key prefixes of length
+    template <typename KeyTraits>
+    struct PrefixClassifier
+    {
+        unsigned length;
+
+        unsigned getBucketNum() const
+        {
+            return KeyTraits::getPrefixNum(length);
+        }
+
+        unsigned operator()(typename KeyTraits::key_type key) const
+        {
+            return KeyTraits::getPrefix(key, length);
+        }
+
+        bool isSorted(unsigned) const
+        {
+            return false;
+        }
+    };
+
+    /**
+     *buckets between splitter keys. every splitter has a bucket of its own for the keys equal to it, so heavy
+     *duplicates fill that bucket instead of unbalancing their neighbours: bucket 2i holds the keys between
+     *splitters i - 1 and i, bucket 2i + 1 the keys equal to splitter i
+     */
+    template <typename KeyTraits>
+    struct SplitterClassifier
+    {
+        typedef typename KeyTraits::key_type key_type;
+
+        std::vector<key_type> splitters; // ascending, no duplicates
+
+        unsigned getBucketNum() const
+        {
+            return static_cast<unsigned>(2 * splitters.size() + 1);
+        }
+
+        unsigned operator()(key_type key) const
+        {
+            unsigned j = static_cast<unsigned>(std::upper_bound(splitters.begin(), splitters.end(), key) - splitters.begin());
+            return j > 0 && splitters[j - 1] == key ? 2 * j - 1 : 2 * j;
+        }
+
+        // equal exact keys are equal values, otherwise less still has to order them
+        bool isSorted(unsigned bucket) const
+        {
+            return KeyTraits::isExact && bucket % 2 == 1;
+        }
+    };
+
+    /**
+     *choose the splitters of a sample sort over splitNum + 1 buckets: sort the keys of a random sample of
+     *SAMPLES_PER_SPLITTER values per bucket and take every SAMPLES_PER_SPLITTER-th. the oversampling makes a bucket
+     *of more than about twice its share unlikely for any input, keys repeated that often become splitters and go to
+     *their own buckets
+     */
+    template <typename T, typename KeyTraits>
+    SplitterClassifier<KeyTraits> chooseSplitters(const T *values, size_t total, unsigned splitNum)
+    {
+        SplitterClassifier<KeyTraits> classifier;
+        if (splitNum == 0 || total < MIN_TASK_SIZE)
+        {
+            return classifier;
+        }
+
+        const size_t sampleSize = SAMPLES_PER_SPLITTER * (splitNum + 1);
+        std::vector<typename KeyTraits::key_type> sample(sampleSize);
+        std::mt19937_64 mt(total); // a fixed seed keeps the buckets, and so the timings, reproducible
+        std::uniform_int_distribution<size_t> dist(0, total - 1);
+        for (auto &key : sample)
+        {
+            key = KeyTraits::toKey(values[dist(mt)]);
+        }
+        std::sort(sample.begin(), sample.end());
+
+        for (unsigned i = 1; i <= splitNum; ++i)
+        {
+            auto key = sample[sampleSize * i / (splitNum + 1)];
+            if (classifier.splitters.empty() || classifier.splitters.back() != key)
+            {
+                classifier.splitters.push_back(key);
+            }
+        }
+        return classifier;
+    }
+
+    /**
+     *count the values of every worker's slice per bucket of classifier
+     */
+    template <typename T, typename KeyTraits, typename Classifier>
+    std::vector<std::vector<size_t>> countBuckets(ThreadPool &pool, const T *values, size_t total, const Classifier &classifier, SortStats *stats = nullptr)
+    {
+        const unsigned workerNum = pool.getWorkerNum() + 1; // the waiting thread works too
+        const unsigned bucketNum = classifier.getBucketNum();
+        std::vector<std::vector<size_t>> histograms(workerNum); // allocated by each worker, so they never share a cache line
+        runOnWorkers(pool, workerNum, [&](unsigned w) {
+            recordPlacement(stats, pool);
+            auto &counts = histograms[w];
+            counts.assign(bucketNum, 0);
+            for (size_t i = getSliceBegin(total, workerNum, w), end = getSliceBegin(total, workerNum, w + 1); i < end; ++i)
+            {
+                ++counts[classifier(KeyTraits::toKey(values[i]))];
+            }
+        }, getPartitionSeconds(stats));
+        return histograms;
+    }
+
+    /**
+     *turn the histograms of countBuckets into the offsets every worker writes its values of each bucket to, by a
+     *bucket-major prefix sum, so that each worker owns a contiguous run inside every bucket.
+     *bucket i ends up in [bucketBegins[i], bucketBegins[i + 1])
+     */
+    inline void toScatterOffsets(std::vector<std::vector<size_t>> &histograms, size_t total, std::vector<size_t> &bucketBegins)
+    {
+        const size_t bucketNum = histograms.front().size();
+        bucketBegins.resize(bucketNum + 1);
+        size_t offset = 0;
+        for (size_t b = 0; b < bucketNum; ++b)
+        {
+            bucketBegins[b] = offset;
+            for (auto &histogram : histograms)
+            {
+                size_t count = histogram[b];
+                histogram[b] = offset;
+                offset += count;
+            }
+        }
+        bucketBegins[bucketNum] = total;
+    }
+
+    // every worker writes makeItem(i) of each value i of its slice straight to its place in items, by offsets
+    template <typename T, typename KeyTraits, typename Classifier, typename Item, typename MakeItem>
+    void scatter(ThreadPool &pool, const T *values, size_t total, const Classifier &classifier, Item *items, const MakeItem &makeItem, std::vector<std::vector<size_t>> &offsets, SortStats *stats)
+    {
+        const unsigned workerNum = pool.getWorkerNum() + 1;
+        runOnWorkers(pool, workerNum, [&](unsigned w) {
+            auto &workerOffsets = offsets[w];
+            for (size_t i = getSliceBegin(total, workerNum, w), end = getSliceBegin(total, workerNum, w + 1); i < end; ++i)
+            {
+                unsigned bucket = classifier(KeyTraits::toKey(values[i]));
+                items[workerOffsets[bucket]++] = makeItem(i);
+            }
+        }, getPartitionSeconds(stats));
+        if (stats)
+        {
+            stats->bytesMoved += total * sizeof(Item);
+        }
+    }
+
+    /**
+     *scatter the values into the buckets of classifier, with two passes over memory: every worker counts its own
+     *slice per bucket, a prefix sum turns the counts into exact write offsets, then every worker writes
+     *makeItem(i) of each value i straight to its final place in items.
+     *bucket i ends up in [bucketBegins[i], bucketBegins[i + 1])
+     */
+    template <typename T, typename KeyTraits, typename Classifier, typename Item, typename MakeItem>
+    void partition(ThreadPool &pool, const T *values, size_t total, const Classifier &classifier, std::vector<Item> &items, const MakeItem &makeItem, std::vector<size_t> &bucketBegins, SortStats *stats = nullptr)
+    {
+        // pass 1, local histograms
+        std::vector<std::vector<size_t>> histograms = countBuckets<T, KeyTraits>(pool, values, total, classifier, stats);
+        toScatterOffsets(histograms, total, bucketBegins);
+
+        // pass 2, scatter every value straight to its final place
+        items.resize(total);
+        scatter<T, KeyTraits>(pool, values, total, classifier, items.data(), makeItem, histograms, stats);
+    }
+
+    /**
+     *an array of items first touched by the workers that are going to use it: job w of runOnEachWorker
+     *constructs [begins[w], begins[w + 1]), so on a NUMA machine the pages of each part are on the node of its
+     *worker. std::vector would have touched all of it on the calling thread
+     */
+    template <typename Item>
+    class LocalBuffer
+    {
+      public:
+        LocalBuffer(ThreadPool &pool, const std::vector<size_t> &begins) : items(static_cast<Item *>(::operator new(begins.back() * sizeof(Item)))), size(begins.back())
+        {
+            runOnEachWorker(pool, [&](unsigned w) {
+                for (size_t i = begins[w]; i < begins[w + 1]; ++i)
+                {
+                    new (items + i) Item();
+                }
+            });
+        }
+
+        ~LocalBuffer()
+        {
+            for (size_t i = 0; i < size; ++i)
+            {
+                items[i].~Item();
+            }
+            ::operator delete(items);
+        }
+
+        LocalBuffer(const LocalBuffer &) = delete;
+        LocalBuffer &operator=(const LocalBuffer &) = delete;
+
+        Item *get() const
+        {
+            return items;
+        }
+
+      private:
+        Item *items;
+        size_t size;
+    };
+
+    /**
+     *the buckets low ~ high of Inner as they are, with all the buckets before low as bucket 0 and all the ones after
+     *high as the last bucket, e.g. to set apart the buckets a rank can be in
+     */
+    template <typename Inner>
+    struct ClampedClassifier
+    {
+        Inner inner;
+        unsigned low;
+        unsigned high;
+
+        unsigned getBucketNum() const
+        {
+            return high - low + 3;
+        }
+
+        template <typename Key>
+        unsigned operator()(Key key) const
+        {
+            unsigned bucket = inner(key);
+            return bucket < low ? 0 : bucket > high ? high - low + 2 : bucket - low + 1;
+        }
+
+        bool isSorted(unsigned) const
+        {
+            return false;
+        }
+
+        // the bucket begins of this from those of inner
+        std::vector<size_t> getBucketBegins(const std::vector<size_t> &innerBegins) const
+        {
+            std::vector<size_t> bucketBegins(1, 0);
+            bucketBegins.insert(bucketBegins.end(), innerBegins.begin() + low, innerBegins.begin() + high + 2);
+            bucketBegins.push_back(innerBegins.back());
+            return bucketBegins;
+        }
+    };
+
+    /**
+     *the begins of the buckets from the per-worker histograms, with the total at the end
+     */
+    inline std::vector<size_t> sumBuckets(const std::vector<std::vector<size_t>> &histograms)
+    {
+        const size_t bucketNum = histograms.front().size();
+        std::vector<size_t> bucketBegins(bucketNum + 1, 0);
+        for (size_t b = 0; b < bucketNum; ++b)
+        {
+            size_t count = 0;
+            for (auto &histogram : histograms)
+            {
+                count += histogram[b];
+            }
+            bucketBegins[b + 1] = bucketBegins[b] + count;
+        }
+        return bucketBegins;
+    }
+
+    /**
+     *the bucket that holds rank
+     */
+    inline unsigned findBucket(const std::vector<size_t> &bucketBegins, size_t rank)
+    {
+        return static_cast<unsigned>(std::upper_bound(bucketBegins.begin(), bucketBegins.end(), rank) - bucketBegins.begin() - 1);
+    }
+
+    /**
+     *permute the values in place so that bucket i ends up in [bucketBegins[i], bucketBegins[i + 1]), with
+     *O(buckets * workers) extra memory. this is American flag sort on all workers: the unplaced part of every
+     *bucket is cut into one stripe per worker, and each worker runs the swap cycles of American flag sort through
+     *its own stripes only. a value whose stripe in its bucket is already full gets parked at the back of the
+     *current stripe, then the placed values of every bucket are gathered at its front and the parked ones go
+     *round again. one worker never has to park anything, so rounds that place less than half of what is left
+     *are done by a single worker, which finishes
+     */
+    template <typename T, typename KeyTraits, typename Classifier>
+    void permuteInPlace(ThreadPool &pool, T *values, size_t total, const Classifier &classifier, const std::vector<size_t> &bucketBegins, SortStats *stats = nullptr)
+    {
+        const unsigned workerNum = pool.getWorkerNum() + 1;
+        const unsigned bucketNum = classifier.getBucketNum();
+        auto getBucket = [&classifier](const T &value) {
+            return classifier(KeyTraits::toKey(value));
+        };
+
+        std::vector<size_t> heads(bucketBegins.begin(), bucketBegins.end() - 1); // the first unplaced slot of every bucket
+        std::vector<std::vector<size_t>> nexts(workerNum);                         // per stripe, the first slot not yet filled with a placed value
+        std::vector<std::vector<size_t>> parkBegins(workerNum);                    // per stripe, where the parked values start
+        size_t remaining = total;
+        unsigned stripeNum = total < MIN_TASK_SIZE ? 1 : workerNum;
+        while (remaining > 0)
+        {
+            auto getStripeBegin = [&](unsigned b, unsigned t) {
+                return heads[b] + (bucketBegins[b + 1] - heads[b]) * t / stripeNum;
+            };
+            if (stats)
+            {
+                stats->bytesMoved += remaining * sizeof(T); // about one move per value left, parked or placed
+            }
+
+            // speculative permutation, every worker only touches its own stripes
+            runOnWorkers(pool, stripeNum, [&](unsigned t) {
+                auto &next = nexts[t];
+                auto &parkBegin = parkBegins[t];
+                next.resize(bucketNum);
+                parkBegin.resize(bucketNum);
+                for (unsigned b = 0; b < bucketNum; ++b)
+                {
+                    next[b] = getStripeBegin(b, t);
+                    parkBegin[b] = getStripeBegin(b, t + 1);
+                }
+
+                for (unsigned b = 0; b < bucketNum; ++b)
+                {
+                    while (next[b] < parkBegin[b])
+                    {
+                        unsigned k = getBucket(values[next[b]]);
+                        if (k == b)
+                        {
+                            ++next[b];
+                            continue;
+                        }
+
+                        // carry the value along its swap cycle until one for this slot comes back
+                        const size_t hole = next[b];
+                        T carried = std::move(values[hole]);
+                        while (k != b && next[k] < parkBegin[k])
+                        {
+                            std::swap(carried, values[next[k]++]);
+                            k = getBucket(carried);
+                        }
+                        if (k == b)
+                        {
+                            values[hole] = std::move(carried);
+                            ++next[b];
+                        }
+                        else
+                        {
+                            --parkBegin[b];
+                            if (hole != parkBegin[b])
+                            {
+                                values[hole] = std::move(values[parkBegin[b]]);
+                            }
+                            values[parkBegin[b]] = std::move(carried);
+                        }
+                    }
+                }
+            }, getPartitionSeconds(stats));
+
+            // gather the placed values of every bucket at its front, the parked ones behind them are left to place
+            const size_t lastRemaining = remaining;
+            runOnWorkers(pool, workerNum, [&](unsigned w) {
+                for (unsigned b = w; b < bucketNum; b += workerNum)
+                {
+                    size_t placedEnd = heads[b];
+                    for (unsigned t = 0; t < stripeNum; ++t)
+                    {
+                        for (size_t i = getStripeBegin(b, t); i < nexts[t][b]; ++i, ++placedEnd)
+                        {
+                            if (i != placedEnd)
+                            {
+                                std::swap(values[i], values[placedEnd]);
+                            }
+                        }
+                    }
+                    heads[b] = placedEnd;
+                }
+            }, getPartitionSeconds(stats));
+            remaining = 0;
+            for (unsigned b = 0; b < bucketNum; ++b)
+            {
+                remaining += bucketBegins[b + 1] - heads[b];
+            }
+            if (remaining * 2 > lastRemaining || remaining < MIN_TASK_SIZE)
+            {
+                stripeNum = 1;
+            }
+        }
+    }
+
+    /**
+     *count the buckets of classifier, then permute the values in place into them
+     */
+    template <typename T, typename KeyTraits, typename Classifier>
+    void partitionInPlace(ThreadPool &pool, T *values, size_t total, const Classifier &classifier, std::vector<size_t> &bucketBegins, SortStats *stats = nullptr)
+    {
+        bucketBegins = sumBuckets(countBuckets<T, KeyTraits>(pool, values, total, classifier, stats));
+        permuteInPlace<T, KeyTraits>(pool, values, total, classifier, bucketBegins, stats);
+    }
+
+    /**
+     *rearrange the values in place as std::nth_element does: values[rank] becomes the value that would be there if
+     *they were sorted, with no value after it before it in the order and none before it after it. while the range is
+     *big, it is cut into SELECT_FAN_OUT sample sort buckets on all workers and only the bucket holding rank is kept
+     */
+    template <typename T, typename KeyTraits>
+    void selectInPlace(ThreadPool &pool, T *values, size_t total, size_t rank)
+    {
+        typedef SortItems<T, KeyTraits, false> Items;
+        const unsigned workerNum = pool.getWorkerNum() + 1;
+        while (total > MIN_TASK_SIZE && workerNum > 1)
+        {
+            auto classifier = chooseSplitters<T, KeyTraits>(values, total, SELECT_FAN_OUT - 1);
+            std::vector<size_t> bucketBegins;
+            partitionInPlace<T, KeyTraits>(pool, values, total, classifier, bucketBegins);
+            unsigned bucket = findBucket(bucketBegins, rank);
+            const size_t size = bucketBegins[bucket + 1] - bucketBegins[bucket];
+            if (classifier.isSorted(bucket))
+            {
+                return;
+            }
+            if (size == total)
+            {
+                break; // the splitters did not cut anything off, e.g. keys that are all equal but not exact
+            }
+            values += bucketBegins[bucket];
+            rank -= bucketBegins[bucket];
+            total = size;
+        }
+        std::nth_element(values, values + rank, values + total, Items::less);
+    }
+
+    /**
+     *the distinct items a sort that drops duplicates keeps, as runs: every sorted leaf moves the first item of each
+     *of its runs of equivalent items to its front and adds itself here, with the length of each run in counts if
+     *isCounted. equivalent items never go to different buckets, but a bucket that was cut may have them on both
+     *sides of a cut, join() takes care of that
+     */
+    template <typename Items>
+    struct DistinctRuns
+    {
+        typedef typename Items::item_type Item;
+
+        struct Run
+        {
+            Item *begin;
+            size_t size;                // distinct items at begin
+            std::vector<size_t> counts; // if isCounted
+            size_t skipped;             // 1 if the first item is the last one of the run before, set by join()
+            size_t offset;              // where the distinct items after the skipped one go, set by join()
+        };
+
+        bool isCounted;
+        std::mutex mutex;
+        std::vector<Run> runs;
+
+        explicit DistinctRuns(bool isCounted) : isCounted(isCounted)
+        {
+        }
+
+        // called by a leaf once begin ~ end is sorted
+        void add(Item *begin, Item *end)
+        {
+            Run run{begin, 0, std::vector<size_t>(), 0, 0};
+            for (Item *item = begin; item != end;)
+            {
+                Item *runEnd = item + 1;
+                while (runEnd != end && !Items::less(*item, *runEnd))
+                {
+                    ++runEnd;
+                }
+                if (isCounted)
+                {
+                    run.counts.push_back(runEnd - item);
+                }
+                if (begin + run.size != item)
+                {
+                    begin[run.size] = std::move(*item);
+                }
+                ++run.size;
+                item = runEnd;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            runs.push_back(std::move(run));
+        }
+
+        // put the runs in order and merge the equivalent items where leaves meet, return the number of distinct items
+        size_t join()
+        {
+            std::sort(runs.begin(), runs.end(), [](const Run &a, const Run &b) {
+                return a.begin < b.begin;
+            });
+            size_t offset = 0;
+            Run *previous = nullptr;
+            for (auto &run : runs)
+            {
+                run.skipped = previous && !Items::less(previous->begin[previous->size - 1], run.begin[0]);
+                if (run.skipped && isCounted)
+                {
+                    previous->counts.back() += run.counts.front();
+                }
+                run.offset = offset;
+                offset += run.size - run.skipped;
+                if (run.size > run.skipped)
+                {
+                    previous = &run;
+                }
+            }
+            return offset;
+        }
+
+        // set(i, item, count) for every distinct item i in order on all workers, after join(). count is 0 unless isCounted
+        template <typename Set>
+        void forEach(ThreadPool &pool, size_t total, const Set &set) const
+        {
+            const unsigned workerNum = pool.getWorkerNum() + 1;
+            runOnWorkers(pool, workerNum, [&](unsigned w) {
+                const size_t begin = getSliceBegin(total, workerNum, w);
+                const size_t end = getSliceBegin(total, workerNum, w + 1);
+                // the first run with items in the slice, the one before it may reach into the slice too
+                size_t r = std::lower_bound(runs.begin(), runs.end(), begin, [](const Run &run, size_t offset) {
+                    return run.offset < offset;
+                }) - runs.begin();
+                r -= r > 0;
+                for (; r < runs.size() && runs[r].offset < end; ++r)
+                {
+                    const Run &run = runs[r];
+                    const size_t first = std::max(begin, run.offset) - run.offset + run.skipped;
+                    const size_t last = std::min(end, run.offset + run.size - run.skipped) - run.offset + run.skipped;
+                    for (size_t i = first; i < last; ++i)
+                    {
+                        set(run.offset + i - run.skipped, run.begin[i], isCounted ? run.counts[i] : 0);
+                    }
+                }
+            });
+        }
+    };
+
+    /**
+     *sorts one bucket of items. a range above splitSize is cut at its median into two sub-tasks on group, so that
+     *idle workers can steal half of a hot bucket. the sorted values go back to out, unless out is null because the
+     *items are the values themselves. a bucket that isSorted is only cut and written back. the time the tasks of a
+     *bucket take is added to nanoseconds, if not null. the values sorted are counted in progress, and once it is
+     *cancelled the tasks left only write back. with distinct, a sorted leaf is added there instead of written back
+     */
+    template <typename T, typename Items>
+    struct BucketTask
+    {
+        typedef typename Items::item_type Item;
+
+        Item *begin;
+        Item *end;
+        T *out;
+        bool isSorted;
+        std::atomic<long long> *nanoseconds;
+        SortProgress *progress;
+        DistinctRuns<Items> *distinct;
+
+        BucketTask(Item *begin, Item *end, T *out, bool isSorted, std::atomic<long long> *nanoseconds, SortProgress *progress, DistinctRuns<Items> *distinct)
+        {
+            this->begin = begin;
+            this->end = end;
+            this->out = out;
+            this->isSorted = isSorted;
+            this->nanoseconds = nanoseconds;
+            this->progress = progress;
+            this->distinct = distinct;
+        }
+
+        void run(TaskGroup &group, size_t splitSize) const
+        {
+            const size_t size = end - begin;
+            if (size > splitSize)
+            {
+                Item *mid = begin + size / 2;
+                if (!isSorted && !isCancelled(progress))
+                {
+                    BusyTimer timer(nanoseconds);
+                    std::nth_element(begin, mid, end, Items::less);
+                }
+                BucketTask left{begin, mid, out, isSorted, nanoseconds, progress, distinct};
+                BucketTask right{mid, end, out ? out + size / 2 : nullptr, isSorted, nanoseconds, progress, distinct};
+                group.run([left, &group, splitSize] {
+                    left.run(group, splitSize);
+                });
+                right.run(group, splitSize);
+                return;
+            }
+
+            BusyTimer timer(nanoseconds);
+            if (!isSorted && !isCancelled(progress))
+            {
+                LeafSorter<Items>::sort(begin, end);
+            }
+            if (distinct)
+            {
+                distinct->add(begin, end);
+            }
+            else if (out)
+            {
+                T *value = out;
+                for (Item *item = begin; item != end; ++item, ++value)
+                {
+                    Items::toValue(*item, *value);
+                }
+            }
+            addProgress(progress, size);
+        }
+    };
+
+    /**
+     *sort every non-empty bucket of items as a task, big ones split further, and wait for all of them
+     */
+    template <typename T, typename Items, typename Classifier>
+    void sortBuckets(ThreadPool &pool, typename Items::item_type *items, const std::vector<size_t> &bucketBegins, const Classifier &classifier, T *out, SortStats *stats = nullptr, SortProgress *progress = nullptr,
+                     DistinctRuns<Items> *distinct = nullptr)
+    {
+        const size_t total = bucketBegins.back();
+        const size_t bucketNum = bucketBegins.size() - 1;
+        const size_t splitSize = std::max(MIN_TASK_SIZE, total / (4 * (pool.getWorkerNum() + 1)));
+        std::unique_ptr<std::atomic<long long>[]> bucketNanoseconds(stats ? new std::atomic<long long>[bucketNum]() : nullptr);
+        TaskGroup group(pool);
+        for (size_t i = 0; i < bucketNum; ++i)
+        {
+            if (bucketBegins[i] == bucketBegins[i + 1])
+            {
+                continue;
+            }
+            BucketTask<T, Items> task{items + bucketBegins[i], items + bucketBegins[i + 1], out ? out + bucketBegins[i] : nullptr,
+                                      classifier.isSorted(static_cast<unsigned>(i)), stats ? &bucketNanoseconds[i] : nullptr, progress, distinct};
+            group.run([task, &group, splitSize] {
+                task.run(group, splitSize);
+            });
+        }
+        group.wait();
+
+        if (stats)
+        {
+            stats->bucketSizes.resize(bucketNum);
+            stats->bucketSortSeconds.resize(bucketNum);
+            for (size_t i = 0; i < bucketNum; ++i)
+            {
+                stats->bucketSizes[i] = bucketBegins[i + 1] - bucketBegins[i];
+                stats->bucketSortSeconds[i] = bucketNanoseconds[i] * 1e-9;
+            }
+            stats->bytesMoved += out ? total * sizeof(T) : 0;
+        }
+    }
+
+    /**
+     *one pass of the LSD radix sort: stable scatter of src into dst by the key digit at shift. every worker
+     *counts the digits of its slice, then writes its items through small per-digit buffers that are flushed
+     *SCATTER_BLOCK items at a time, so that the 256 write streams do not evict each other
+     */
+    template <typename Items, typename Item>
+    void radixPass(ThreadPool &pool, std::vector<Item> &src, std::vector<Item> &dst, unsigned shift)
+    {
+        const size_t total = src.size();
+        const unsigned workerNum = pool.getWorkerNum() + 1;
+        std::vector<std::vector<size_t>> histograms(workerNum);
+
+        auto getDigit = [shift](const Item &item) {
+            return static_cast<unsigned>(Items::getKey(item) >> shift) & (RADIX - 1);
+        };
+
+        runOnWorkers(pool, workerNum, [&](unsigned w) {
+            auto &counts = histograms[w];
+            counts.assign(RADIX, 0);
+            for (size_t i = getSliceBegin(total, workerNum, w), end = getSliceBegin(total, workerNum, w + 1); i < end; ++i)
+            {
+                ++counts[getDigit(src[i])];
+            }
+        });
+
+        // digit-major prefix sum keeps the pass stable: a worker's items go after those of the workers before it
+        size_t offset = 0;
+        for (unsigned d = 0; d < RADIX; ++d)
+        {
+            for (auto &histogram : histograms)
+            {
+                size_t count = histogram[d];
+                histogram[d] = offset;
+                offset += count;
+            }
+        }
+
+        runOnWorkers(pool, workerNum, [&](unsigned w) {
+            auto &offsets = histograms[w];
+            std::vector<Item> buffer(RADIX * SCATTER_BLOCK);
+            std::vector<unsigned> buffered(RADIX, 0);
+            for (size_t i = getSliceBegin(total, workerNum, w), end = getSliceBegin(total, workerNum, w + 1); i < end; ++i)
+            {
+                unsigned d = getDigit(src[i]);
+                buffer[d * SCATTER_BLOCK + buffered[d]] = std::move(src[i]);
+                if (++buffered[d] == SCATTER_BLOCK)
+                {
+                    std::move(buffer.begin() + d * SCATTER_BLOCK, buffer.begin() + (d + 1) * SCATTER_BLOCK, dst.begin() + offsets[d]);
+                    offsets[d] += SCATTER_BLOCK;
+                    buffered[d] = 0;
+                }
+            }
+            for (unsigned d = 0; d < RADIX; ++d)
+            {
+                std::move(buffer.begin() + d * SCATTER_BLOCK, buffer.begin() + d * SCATTER_BLOCK + buffered[d], dst.begin() + offsets[d]);
+            }
+        });
+    }
+
+    /**
+     *fill items with makeItem(0) ~ makeItem(total - 1) and sort them by a parallel LSD radix sort over the whole
+     *keys, RADIX_BITS per pass. digits that are the same in every key are skipped, e.g. the high ones when all
+     *numbers are small. making the items counts as the first step of every value in progress and the passes as the
+     *second, the passes left are skipped once it is cancelled
+     */
+    template <typename Items, typename Item, typename MakeItem>
+    void radixSort(ThreadPool &pool, size_t total, std::vector<Item> &items, const MakeItem &makeItem, SortStats *stats, SortProgress *progress = nullptr)
+    {
+        typedef typename Items::key_type key_type;
+        const unsigned workerNum = pool.getWorkerNum() + 1;
+        items.resize(total);
+
+        // make the items, and find out which key bits differ anywhere: from the first key of the same slice, or
+        // between the first keys of two slices
+        key_type different = 0;
+        if (stats)
+        {
+            stats->bytesMoved += total * sizeof(Item);
+        }
+        {
+            PhaseTimer timer(stats, "keys");
+            std::vector<key_type> differentBits(workerNum, 0);
+            runOnWorkers(pool, workerNum, [&](unsigned w) {
+                recordPlacement(stats, pool);
+                const size_t begin = getSliceBegin(total, workerNum, w);
+                const size_t end = getSliceBegin(total, workerNum, w + 1);
+                key_type firstKey = 0;
+                key_type bits = 0;
+                for (size_t i = begin; i < end; ++i)
+                {
+                    items[i] = makeItem(i);
+                    key_type key = Items::getKey(items[i]);
+                    firstKey = i == begin ? key : firstKey;
+                    bits |= key ^ firstKey;
+                }
+                differentBits[w] = bits;
+            });
+            for (unsigned w = 0; w < workerNum; ++w)
+            {
+                const size_t begin = getSliceBegin(total, workerNum, w);
+                if (begin < getSliceBegin(total, workerNum, w + 1))
+                {
+                    different |= differentBits[w] | (Items::getKey(items[begin]) ^ Items::getKey(items[0]));
+                }
+            }
+        }
+        addProgress(progress, total);
+
+        PhaseTimer timer(stats, "radix");
+        unsigned passNum = 0;
+        for (unsigned shift = 0; shift < sizeof(key_type) * 8; shift += RADIX_BITS)
+        {
+            passNum += (static_cast<unsigned>(different >> shift) & (RADIX - 1)) != 0;
+        }
+        std::vector<Item> buffer(total);
+        for (unsigned shift = 0, pass = 0; shift < sizeof(key_type) * 8 && !isCancelled(progress); shift += RADIX_BITS)
+        {
+            if (static_cast<unsigned>(different >> shift) & (RADIX - 1))
+            {
+                radixPass<Items>(pool, items, buffer, shift);
+                items.swap(buffer);
+                if (stats)
+                {
+                    stats->bytesMoved += total * sizeof(Item);
+                }
+                addProgress(progress, total * (pass + 1) / passNum - total * pass / passNum);
+                ++pass;
+            }
+        }
+    }
+
+    /**
+     *write items[i] back with set(i, items[i]) on all workers, set writes itemBytes per item
+     */
+    template <typename Item, typename Set>
+    void writeBack(ThreadPool &pool, std::vector<Item> &items, const Set &set, size_t itemBytes, SortStats *stats)
+    {
+        const size_t total = items.size();
+        if (stats)
+        {
+            stats->bytesMoved += total * itemBytes;
+        }
+        const unsigned workerNum = pool.getWorkerNum() + 1;
+        runOnWorkers(pool, workerNum, [&](unsigned w) {
+            for (size_t i = getSliceBegin(total, workerNum, w), end = getSliceBegin(total, workerNum, w + 1); i < end; ++i)
+            {
+                set(i, items[i]);
+            }
+        });
+    }
+
+    /**
+     *order every run of equal keys in a sorted order by less on the values they index. a run belongs to the
+     *worker whose slice it starts in
+     */
+    template <typename T, typename KeyTraits>
+    void sortEqualKeys(ThreadPool &pool, const T *values, std::vector<typename KeyTraits::key_type> &keys, std::vector<size_t> &order)
+    {
+        const size_t total = order.size();
+        const unsigned workerNum = pool.getWorkerNum() + 1;
+        runOnWorkers(pool, workerNum, [&](unsigned w) {
+            size_t begin = getSliceBegin(total, workerNum, w);
+            const size_t end = getSliceBegin(total, workerNum, w + 1);
+            while (begin > 0 && begin < end && keys[begin - 1] == keys[begin])
+            {
+                ++begin;
+            }
+            while (begin < end)
+            {
+                size_t runEnd = begin + 1;
+                while (runEnd < total && keys[runEnd] == keys[begin])
+                {
+                    ++runEnd;
+                }
+                if (runEnd - begin > 1)
+                {
+                    std::sort(order.begin() + begin, order.begin() + runEnd, [values](size_t a, size_t b) {
+                        return KeyTraits::less(values[a], values[b]);
+                    });
+                }
+                begin = runEnd;
+            }
+        });
+    }
+}
+
+/**
+ *a parallel sorter for a contiguous range of T owned by the caller, in the order KeyTraits gives (see SortKeys.h),
+ *e.g. BucketSorter<uint64_t, NumericKey<uint64_t>>, BucketSorter<std::string> or
+ *BucketSorter<Employee, FieldKey<Employee, unsigned, &Employee::id>>.
+ *values that cannot be decoded from their keys are moved into an internal buffer and back, so T has to be default
+ *constructible and move assignable
+ */
+template <typename T, typename KeyTraits = LexicographicKey<T>>
+class BucketSorter
+{
+  public:
+    // the workers of pool sort, the calling thread joins in
+    explicit BucketSorter(ThreadPool &pool, SortEngine engine = SortEngine::Bucket) : pool(pool), engine(engine), stats(nullptr), progress(nullptr), hasAffinity(false)
+    {
+    }
+
+    /**
+     *affinity mode for sort() with the Bucket and Sample engines, meant for a pinned pool on a NUMA machine. the
+     *buckets are handed out in contiguous runs of about the same size, one run per worker and one for the calling
+     *thread, which a pinned pool pins to the CPU it left free for the length of the sort. every worker first touches
+     *the part of the bucket buffer that holds its run, then sorts its run there and writes it back itself, so its
+     *partitions stay on its own node up to the final gather. a bucket is never split or stolen in this mode, so
+     *skewed values are better sorted with Sample
+     */
+    void setAffinity(bool hasAffinity)
+    {
+        this->hasAffinity = hasAffinity;
+    }
+
+    // fill stats in on every sort, nullptr (the default) turns it off
+    void setStats(SortStats *stats)
+    {
+        this->stats = stats;
+    }
+
+    /**
+     *count the work of sort(), the payload sort() and argsort() in progress, and stop them with SortCancelled once
+     *it is cancelled. nullptr (the default) turns it off
+     */
+    void setProgress(SortProgress *progress)
+    {
+        this->progress = progress;
+    }
+
+    void sort(T *first, T *last) const
+    {
+        const size_t total = last - first;
+        startStats();
+        startProgress(total);
+        if (total > 0)
+        {
+            sortValues(first, total);
+        }
+        finishProgress();
+    }
+
+    /**
+     *sort in the background on the pool and return at once, see SortHandle. the values must be left alone until
+     *its wait() returns, and stats, if set, until the sort is done
+     */
+    SortHandle sortAsync(T *first, T *last) const
+    {
+        BucketSorter sorter = *this;
+        return SortHandle(pool, [sorter, first, last](SortProgress &progress) mutable {
+            sorter.setProgress(&progress);
+            sorter.sort(first, last);
+        });
+    }
+
+    /**
+     *sort the values and move payloads[0 ~ last - first) the same way, so payloads[i] stays with the value first[i].
+     *InPlace sorts as Bucket here, the pairs of values and payloads are moved through one buffer
+     */
+    template <typename Payload>
+    void sort(T *first, T *last, Payload *payloads) const
+    {
+        typedef bucketsort_detail::SortItems<T, KeyTraits> Items;
+        typedef bucketsort_detail::PayloadItems<Items, Payload> Pairs;
+        std::vector<typename Pairs::item_type> pairs;
+        startStats();
+        startProgress(last - first);
+        sortPairs<Pairs>(first, last - first, pairs, [first, payloads](size_t i) {
+            return typename Pairs::item_type(Items::toItem(first[i]), std::move(payloads[i]));
+        });
+
+        {
+            bucketsort_detail::PhaseTimer timer(stats, "values");
+            bucketsort_detail::writeBack(pool, pairs, [first, payloads](size_t i, typename Pairs::item_type &pair) {
+                Items::toValue(pair.first, first[i]);
+                payloads[i] = std::move(pair.second);
+            }, sizeof(T) + sizeof(Payload), stats);
+        }
+        finishProgress();
+    }
+
+    /**
+     *return the permutation that sorts the values and leave them as they are: first[order[0]], first[order[1]], ...
+     *are in order. only keys and indexes are moved, so T is not moved or copied at all
+     */
+    std::vector<size_t> argsort(const T *first, const T *last) const
+    {
+        typedef bucketsort_detail::SortItems<T, KeyTraits, true> Keys;
+        typedef bucketsort_detail::PayloadItems<Keys, size_t> Pairs;
+        const size_t total = last - first;
+        std::vector<typename Pairs::item_type> pairs;
+        startStats();
+        startProgress(total);
+        sortPairs<Pairs>(first, total, pairs, [first](size_t i) {
+            return typename Pairs::item_type(KeyTraits::toKey(first[i]), i);
+        });
+        finishProgress(); // before the order is written, a cancelled one is not worth writing
+
+        bucketsort_detail::PhaseTimer timer(stats, "values");
+        std::vector<size_t> order(total);
+        if (KeyTraits::isExact)
+        {
+            bucketsort_detail::writeBack(pool, pairs, [&order](size_t i, typename Pairs::item_type &pair) {
+                order[i] = pair.second;
+            }, sizeof(size_t), stats);
+            return order;
+        }
+
+        // the keys only order the values partly, less orders the indexes of equal keys
+        std::vector<typename KeyTraits::key_type> keys(total);
+        bucketsort_detail::writeBack(pool, pairs, [&order, &keys](size_t i, typename Pairs::item_type &pair) {
+            keys[i] = pair.first;
+            order[i] = pair.second;
+        }, sizeof(size_t) + sizeof(keys[0]), stats);
+        bucketsort_detail::sortEqualKeys<T, KeyTraits>(pool, first, keys, order);
+        return order;
+    }
+
+    /**
+     *sort the values and keep only the first of every run of equivalent ones, as std::sort and then std::unique
+     *would. the duplicates are dropped while the buckets are sorted, return the end of the distinct values.
+     *Radix and InPlace sort as Bucket here
+     */
+    T *sortUnique(T *first, T *last) const
+    {
+        typedef bucketsort_detail::SortItems<T, KeyTraits> Items;
+        std::vector<typename Items::item_type> items;
+        bucketsort_detail::DistinctRuns<Items> distinct(false);
+        startStats();
+        sortDistinct<Items>(first, last - first, items, [first](size_t i) -> decltype(Items::toItem(*first)) {
+            return Items::toItem(first[i]);
+        }, distinct);
+
+        bucketsort_detail::PhaseTimer timer(stats, "values");
+        const size_t distinctNum = distinct.join();
+        distinct.forEach(pool, distinctNum, [first](size_t i, typename Items::item_type &item, size_t) {
+            Items::toValue(item, first[i]);
+        });
+        if (stats)
+        {
+            stats->bytesMoved += distinctNum * sizeof(T);
+        }
+        return first + distinctNum;
+    }
+
+    /**
+     *the distinct values in order, each with how many of the values are equivalent to it, as a histogram of the
+     *values. the counting is done while the buckets are sorted, and only the output grows with the number of
+     *distinct values. the values are left as they are. Radix and InPlace sort as Bucket here
+     */
+    std::vector<std::pair<T, size_t>> sortCounted(const T *first, const T *last) const
+    {
+        typedef bucketsort_detail::SortItems<T, KeyTraits> Items;
+        typedef typename Items::item_type Item;
+        std::vector<Item> items;
+        bucketsort_detail::DistinctRuns<Items> distinct(true);
+        startStats();
+        sortDistinct<Items>(first, last - first, items, [first](size_t i) -> Item {
+            T value = first[i];
+            return Items::toItem(value);
+        }, distinct);
+
+        bucketsort_detail::PhaseTimer timer(stats, "values");
+        std::vector<std::pair<T, size_t>> counted(distinct.join());
+        distinct.forEach(pool, counted.size(), [&counted](size_t i, Item &item, size_t count) {
+            Items::toValue(item, counted[i].first);
+            counted[i].second = count;
+        });
+        if (stats)
+        {
+            stats->bytesMoved += counted.size() * sizeof(counted[0]);
+        }
+        return counted;
+    }
+
+    /**
+     *rearrange the values as std::partial_sort does: [first, middle) ends up sorted, holding the middle - first
+     *first values in the order, the rest are left in no particular order. only the buckets before the one that
+     *middle falls in are sorted in full, that one is cut at middle by a parallel selection first, the buckets after
+     *it are skipped. the values are permuted in place whatever the engine
+     */
+    void partialSort(T *first, T *middle, T *last) const
+    {
+        typedef bucketsort_detail::SortItems<T, KeyTraits, false> Items;
+        const size_t total = last - first;
+        const size_t k = middle - first;
+        startStats();
+        if (k == 0)
+        {
+            return;
+        }
+
+        bucketsort_detail::ClampedClassifier<bucketsort_detail::PrefixClassifier<KeyTraits>> classifier;
+        std::vector<size_t> bucketBegins;
+        {
+            bucketsort_detail::PhaseTimer timer(stats, "partition");
+            classifier.inner.length = bucketsort_detail::choosePrefixLength<T, KeyTraits>(first, total, pool.getWorkerNum() + 1);
+            std::vector<size_t> prefixBegins = bucketsort_detail::sumBuckets(bucketsort_detail::countBuckets<T, KeyTraits>(pool, first, total, classifier.inner, stats));
+            classifier.low = 0;
+            classifier.high = bucketsort_detail::findBucket(prefixBegins, k - 1);
+            bucketBegins = classifier.getBucketBegins(prefixBegins);
+            bucketsort_detail::permuteInPlace<T, KeyTraits>(pool, first, total, classifier, bucketBegins, stats);
+        }
+
+        // the bucket of middle only needs its part before middle sorted
+        const size_t boundaryBegin = bucketBegins[bucketBegins.size() - 3];
+        const size_t boundaryEnd = bucketBegins[bucketBegins.size() - 2];
+        {
+            bucketsort_detail::PhaseTimer timer(stats, "select");
+            if (k < boundaryEnd)
+            {
+                bucketsort_detail::selectInPlace<T, KeyTraits>(pool, first + boundaryBegin, boundaryEnd - boundaryBegin, k - boundaryBegin);
+            }
+        }
+        bucketBegins.resize(bucketBegins.size() - 2);
+        bucketBegins.push_back(k);
+
+        bucketsort_detail::PhaseTimer timer(stats, "sort");
+        bucketsort_detail::sortBuckets<T, Items>(pool, first, bucketBegins, classifier, nullptr, stats);
+    }
+
+    /**
+     *rearrange the values as std::nth_element does, only the bucket that nth falls in is searched, by a parallel
+     *selection
+     */
+    void nthElement(T *first, T *nth, T *last) const
+    {
+        const size_t total = last - first;
+        const size_t rank = nth - first;
+        startStats();
+        if (rank >= total)
+        {
+            return;
+        }
+
+        bucketsort_detail::ClampedClassifier<bucketsort_detail::PrefixClassifier<KeyTraits>> classifier;
+        std::vector<size_t> bucketBegins;
+        {
+            bucketsort_detail::PhaseTimer timer(stats, "partition");
+            classifier.inner.length = bucketsort_detail::choosePrefixLength<T, KeyTraits>(first, total, pool.getWorkerNum() + 1);
+            std::vector<size_t> prefixBegins = bucketsort_detail::sumBuckets(bucketsort_detail::countBuckets<T, KeyTraits>(pool, first, total, classifier.inner, stats));
+            classifier.low = classifier.high = bucketsort_detail::findBucket(prefixBegins, rank);
+            bucketBegins = classifier.getBucketBegins(prefixBegins);
+            bucketsort_detail::permuteInPlace<T, KeyTraits>(pool, first, total, classifier, bucketBegins, stats);
+        }
+
+        bucketsort_detail::PhaseTimer timer(stats, "select");
+        bucketsort_detail::selectInPlace<T, KeyTraits>(pool, first + bucketBegins[1], bucketBegins[2] - bucketBegins[1], rank - bucketBegins[1]);
+    }
+
+  private:
+    // every sort fills stats in afresh
+    void startStats() const
+    {
+        if (stats)
+        {
+            stats->clear();
+            stats->workerNum = pool.getWorkerNum() + 1;
+            stats->workerPartitionSeconds.assign(stats->workerNum, 0);
+            stats->workerCpus.assign(stats->workerNum, -1);
+            stats->workerNodes.assign(stats->workerNum, -1);
+        }
+    }
+
+    // every sort counts its progress afresh, and does not start once cancelled
+    void startProgress(size_t total) const
+    {
+        if (progress)
+        {
+            if (progress->isCancelled)
+            {
+                throw SortCancelled();
+            }
+            progress->doneNum = 0;
+            progress->totalNum = 2 * total;
+        }
+    }
+
+    void finishProgress() const
+    {
+        if (progress)
+        {
+            if (progress->isCancelled)
+            {
+                throw SortCancelled();
+            }
+            progress->doneNum = std::max<size_t>(progress->totalNum, 1); // so that a sort of nothing reads as done too
+        }
+    }
+
+    // choose the buckets for the values by the engine, and hand them to job as a classifier
+    template <typename Job>
+    void classify(const T *first, size_t total, const Job &job) const
+    {
+        const unsigned workerNum = pool.getWorkerNum() + 1;
+        if (engine == SortEngine::Sample)
+        {
+            bucketsort_detail::SplitterClassifier<KeyTraits> classifier;
+            {
+                bucketsort_detail::PhaseTimer timer(stats, "sample");
+                classifier = bucketsort_detail::chooseSplitters<T, KeyTraits>(first, total, workerNum - 1);
+            }
+            job(classifier);
+            return;
+        }
+
+        // how many prefix buckets depends on the cores and the values
+        bucketsort_detail::PrefixClassifier<KeyTraits> classifier;
+        {
+            bucketsort_detail::PhaseTimer timer(stats, "sample");
+            classifier.length = bucketsort_detail::choosePrefixLength<T, KeyTraits>(first, total, workerNum);
+        }
+        job(classifier);
+    }
+
+    // fill pairs with makePair(0) ~ makePair(total - 1) and sort them on the engine, the caller writes them back
+    template <typename Pairs, typename MakePair>
+    void sortPairs(const T *first, size_t total, std::vector<typename Pairs::item_type> &pairs, const MakePair &makePair) const
+    {
+        if (total == 0)
+        {
+            return;
+        }
+        if (engine == SortEngine::Radix && KeyTraits::isExact)
+        {
+            bucketsort_detail::radixSort<Pairs>(pool, total, pairs, makePair, stats, progress);
+            return;
+        }
+        classify(first, total, [&](const auto &classifier) {
+            std::vector<size_t> bucketBegins;
+            {
+                bucketsort_detail::PhaseTimer timer(stats, "partition");
+                bucketsort_detail::partition<T, KeyTraits>(pool, first, total, classifier, pairs, makePair, bucketBegins, stats);
+            }
+            bucketsort_detail::addProgress(progress, total);
+            bucketsort_detail::PhaseTimer timer(stats, "sort");
+            bucketsort_detail::sortBuckets<typename Pairs::item_type, Pairs>(pool, pairs.data(), bucketBegins, classifier, nullptr, stats, progress);
+        });
+    }
+
+    // fill items with makeItem(0) ~ makeItem(total - 1), sort them per bucket and leave their distinct runs in distinct
+    template <typename Items, typename MakeItem>
+    void sortDistinct(const T *first, size_t total, std::vector<typename Items::item_type> &items, const MakeItem &makeItem, bucketsort_detail::DistinctRuns<Items> &distinct) const
+    {
+        if (total == 0)
+        {
+            return;
+        }
+        classify(first, total, [&](const auto &classifier) {
+            std::vector<size_t> bucketBegins;
+            {
+                bucketsort_detail::PhaseTimer timer(stats, "partition");
+                bucketsort_detail::partition<T, KeyTraits>(pool, first, total, classifier, items, makeItem, bucketBegins, stats);
+            }
+            bucketsort_detail::PhaseTimer timer(stats, "sort");
+            bucketsort_detail::sortBuckets<T, Items>(pool, items.data(), bucketBegins, classifier, nullptr, stats, nullptr, &distinct);
+        });
+    }
+
+    // sort a non-empty range on the engine
+    void sortValues(T *first, size_t total) const
+    {
+        typedef bucketsort_detail::SortItems<T, KeyTraits> Items;
+        if (engine == SortEngine::Radix && KeyTraits::isExact)
+        {
+            std::vector<typename Items::item_type> items;
+            bucketsort_detail::radixSort<Items>(pool, total, items, [first](size_t i) -> decltype(Items::toItem(*first)) {
+                return Items::toItem(first[i]);
+            }, stats, progress);
+            bucketsort_detail::PhaseTimer timer(stats, "values");
+            bucketsort_detail::writeBack(pool, items, [first](size_t i, typename Items::item_type &item) {
+                Items::toValue(item, first[i]);
+            }, sizeof(T), stats);
+            return;
+        }
+        classify(first, total, [this, first, total](const auto &classifier) {
+            this->sortByClassifier(first, total, classifier);
+        });
+    }
+
+    // scatter the values into the buckets of classifier, then sort every bucket
+    template <typename Classifier>
+    void sortByClassifier(T *first, size_t total, const Classifier &classifier) const
+    {
+        std::vector<size_t> bucketBegins;
+        if (engine == SortEngine::InPlace)
+        {
+            typedef bucketsort_detail::SortItems<T, KeyTraits, false> Items;
+            {
+                bucketsort_detail::PhaseTimer timer(stats, "partition");
+                bucketsort_detail::partitionInPlace<T, KeyTraits>(pool, first, total, classifier, bucketBegins, stats);
+            }
+            bucketsort_detail::addProgress(progress, total);
+            bucketsort_detail::PhaseTimer timer(stats, "sort");
+            bucketsort_detail::sortBuckets<T, Items>(pool, first, bucketBegins, classifier, nullptr, stats, progress);
+        }
+        else if (hasAffinity)
+        {
+            sortLocal(first, total, classifier);
+        }
+        else
+        {
+            typedef bucketsort_detail::SortItems<T, KeyTraits> Items;
+            std::vector<typename Items::item_type> items;
+            {
+                bucketsort_detail::PhaseTimer timer(stats, "partition");
+                bucketsort_detail::partition<T, KeyTraits>(pool, first, total, classifier, items, [first](size_t i) -> decltype(Items::toItem(*first)) {
+                    return Items::toItem(first[i]);
+                }, bucketBegins, stats);
+            }
+            bucketsort_detail::addProgress(progress, total);
+            bucketsort_detail::PhaseTimer timer(stats, "sort");
+            bucketsort_detail::sortBuckets<T, Items>(pool, items.data(), bucketBegins, classifier, first, stats, progress);
+        }
+    }
+
+    // sortByClassifier in affinity mode, see setAffinity
+    template <typename Classifier>
+    void sortLocal(T *first, size_t total, const Classifier &classifier) const
+    {
+        typedef bucketsort_detail::SortItems<T, KeyTraits> Items;
+        typedef typename Items::item_type Item;
+        const unsigned workerNum = pool.getWorkerNum() + 1;
+        const unsigned bucketNum = classifier.getBucketNum();
+        CallerPin callerPin(pool); // the last run is the calling thread's, keep it on one node as well
+
+        // worker w owns the buckets that begin in its slice of the values
+        std::vector<size_t> bucketBegins;
+        std::vector<unsigned> ownerBuckets(workerNum + 1, bucketNum);
+        std::vector<size_t> ownerBegins(workerNum + 1, total);
+        std::unique_ptr<bucketsort_detail::LocalBuffer<Item>> items;
+        {
+            bucketsort_detail::PhaseTimer timer(stats, "partition");
+            std::vector<std::vector<size_t>> histograms = bucketsort_detail::countBuckets<T, KeyTraits>(pool, first, total, classifier, stats);
+            bucketsort_detail::toScatterOffsets(histograms, total, bucketBegins);
+            for (unsigned w = 0; w < workerNum; ++w)
+            {
+                auto begin = std::lower_bound(bucketBegins.begin(), bucketBegins.end() - 1, bucketsort_detail::getSliceBegin(total, workerNum, w));
+                ownerBuckets[w] = static_cast<unsigned>(begin - bucketBegins.begin());
+                ownerBegins[w] = *begin;
+            }
+            items.reset(new bucketsort_detail::LocalBuffer<Item>(pool, ownerBegins));
+            bucketsort_detail::scatter<T, KeyTraits>(pool, first, total, classifier, items->get(), [first](size_t i) -> decltype(Items::toItem(*first)) {
+                return Items::toItem(first[i]);
+            }, histograms, stats);
+        }
+        bucketsort_detail::addProgress(progress, total);
+
+        bucketsort_detail::PhaseTimer timer(stats, "sort");
+        if (stats)
+        {
+            stats->bucketSizes.resize(bucketNum);
+            stats->bucketSortSeconds.resize(bucketNum);
+            stats->bytesMoved += total * sizeof(T);
+        }
+        bucketsort_detail::runOnEachWorker(pool, [&](unsigned w) {
+            bucketsort_detail::recordPlacement(stats, pool);
+            for (unsigned b = ownerBuckets[w]; b < ownerBuckets[w + 1]; ++b)
+            {
+                auto start = std::chrono::steady_clock::now();
+                Item *begin = items->get() + bucketBegins[b];
+                Item *end = items->get() + bucketBegins[b + 1];
+                if (!classifier.isSorted(b) && !bucketsort_detail::isCancelled(progress))
+                {
+                    bucketsort_detail::LeafSorter<Items>::sort(begin, end);
+                }
+                T *value = first + bucketBegins[b];
+                for (Item *item = begin; item != end; ++item, ++value)
+                {
+                    Items::toValue(*item, *value);
+                }
+                bucketsort_detail::addProgress(progress, end - begin);
+                if (stats)
+                {
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                    stats->bucketSizes[b] = end - begin;
+                    stats->bucketSortSeconds[b] = elapsed.count();
+                }
+            }
+        });
+    }
+
+    ThreadPool &pool;
+    SortEngine engine;
+    SortStats *stats;
+    SortProgress *progress;
+    bool hasAffinity;
+};
+
+#endif /* BucketSorter_h */
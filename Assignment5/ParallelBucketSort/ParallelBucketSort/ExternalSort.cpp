@@ -0,0 +1,346 @@
+//
+//  ExternalSort.cpp
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#include "ExternalSort.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    typedef LexicographicKey<unsigned int> Key;
+
+    const size_t BYTES_PER_VALUE = 24;      //a value, its key and a radix buffer key while a run is sorted
+    const size_t MIN_BUFFER_SIZE = 1 << 14; //values per merge buffer, 64KB keeps the reads sequential
+    const size_t SAMPLES_PER_WORKER = 32;   //values read from every run to place the merge splitters
+
+    // a file opened with the POSIX calls, positioned reads and writes let the merge workers share it
+    class File
+    {
+      public:
+        File(const std::string &path, int flags) : path(path)
+        {
+            fd = ::open(path.c_str(), flags, 0644);
+            if (fd < 0)
+            {
+                fail("cannot open");
+            }
+        }
+
+        ~File()
+        {
+            ::close(fd);
+        }
+
+        File(const File &) = delete;
+        File &operator=(const File &) = delete;
+
+        size_t getSize() const
+        {
+            struct stat status;
+            if (::fstat(fd, &status) != 0)
+            {
+                fail("cannot stat");
+            }
+            return status.st_size;
+        }
+
+        void read(void *data, size_t bytes, size_t offset) const
+        {
+            char *to = static_cast<char *>(data);
+            while (bytes > 0)
+            {
+                ssize_t done = ::pread(fd, to, bytes, offset);
+                if (done < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (done == 0)
+                {
+                    throw std::runtime_error("unexpected end of " + path);
+                }
+                if (done < 0)
+                {
+                    fail("cannot read");
+                }
+                to += done;
+                bytes -= done;
+                offset += done;
+            }
+        }
+
+        void write(const void *data, size_t bytes, size_t offset) const
+        {
+            const char *from = static_cast<const char *>(data);
+            while (bytes > 0)
+            {
+                ssize_t done = ::pwrite(fd, from, bytes, offset);
+                if (done < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (done <= 0)
+                {
+                    fail("cannot write");
+                }
+                from += done;
+                bytes -= done;
+                offset += done;
+            }
+        }
+
+        unsigned readValue(size_t index) const
+        {
+            unsigned value;
+            read(&value, sizeof(value), index * sizeof(value));
+            return value;
+        }
+
+      private:
+        std::string path;
+        int fd;
+
+        void fail(const std::string &what) const
+        {
+            throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+        }
+    };
+
+    // removes the temporary run files however the sort ends
+    struct TempFiles
+    {
+        std::vector<std::string> paths;
+
+        ~TempFiles()
+        {
+            for (auto &path : paths)
+            {
+                std::remove(path.c_str());
+            }
+        }
+    };
+
+    /**
+     *return the index of the first value of a sorted run whose key is not below key, by binary search on the file
+     */
+    size_t lowerBound(const File &run, size_t size, uint64_t key)
+    {
+        size_t low = 0;
+        size_t high = size;
+        while (low < high)
+        {
+            size_t mid = low + (high - low) / 2;
+            if (Key::toKey(run.readValue(mid)) < key)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    // a buffered reader over [next, end) of one sorted run
+    struct RunCursor
+    {
+        const File *file;
+        size_t next;
+        size_t end;
+        std::vector<unsigned> buffer;
+        size_t position;
+        size_t filled;
+
+        bool refill()
+        {
+            filled = std::min(buffer.size(), end - next);
+            file->read(buffer.data(), filled * sizeof(unsigned), next * sizeof(unsigned));
+            next += filled;
+            position = 0;
+            return filled > 0;
+        }
+    };
+}
+
+ExternalSort::ExternalSort(ThreadPool &pool, size_t memoryBudget, SortEngine engine) : pool(pool), memoryBudget(memoryBudget), engine(engine)
+{
+}
+
+std::vector<ExternalSort::Run> ExternalSort::makeRuns(const std::string &inputPath, const std::string &tempPrefix) const
+{
+    File input(inputPath, O_RDONLY);
+    const size_t bytes = input.getSize();
+    if (bytes % sizeof(unsigned) != 0)
+    {
+        throw std::invalid_argument(inputPath + " is not a file of unsigned ints");
+    }
+    const size_t total = bytes / sizeof(unsigned);
+    const size_t runCapacity = memoryBudget / BYTES_PER_VALUE; // at least MIN_BUFFER_SIZE, see sort
+
+    std::vector<Run> runs;
+    std::vector<unsigned> values;
+    BucketSorter<unsigned> sorter(pool, engine);
+    for (size_t offset = 0; offset < total; offset += values.size())
+    {
+        values.resize(std::min(runCapacity, total - offset));
+        input.read(values.data(), values.size() * sizeof(unsigned), offset * sizeof(unsigned));
+        sorter.sort(values.data(), values.data() + values.size());
+
+        Run run{tempPrefix + std::to_string(runs.size()), values.size()};
+        File(run.path, O_WRONLY | O_CREAT | O_TRUNC).write(values.data(), values.size() * sizeof(unsigned), 0);
+        runs.push_back(run);
+    }
+    return runs;
+}
+
+void ExternalSort::merge(const std::vector<Run> &runs, const std::string &outputPath, unsigned workerNum, size_t bufferSize) const
+{
+    File output(outputPath, O_WRONLY | O_CREAT | O_TRUNC);
+    std::vector<std::unique_ptr<File>> inputs;
+    size_t total = 0;
+    for (auto &run : runs)
+    {
+        inputs.emplace_back(new File(run.path, O_RDONLY));
+        total += run.size;
+    }
+    if (total == 0)
+    {
+        return;
+    }
+
+    // splitters from an even sample of every run give each worker about the same share of the output
+    std::vector<uint64_t> sample;
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        size_t sampleSize = std::min(runs[r].size, SAMPLES_PER_WORKER * workerNum);
+        for (size_t i = 0; i < sampleSize; ++i)
+        {
+            sample.push_back(Key::toKey(inputs[r]->readValue(runs[r].size * i / sampleSize)));
+        }
+    }
+    std::sort(sample.begin(), sample.end());
+
+    // bounds[r][w] ~ bounds[r][w + 1] is the part of run r that worker w merges
+    std::vector<std::vector<size_t>> bounds(runs.size(), std::vector<size_t>(workerNum + 1));
+    std::vector<size_t> outputBegins(workerNum + 1, 0);
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        bounds[r][0] = 0;
+        bounds[r][workerNum] = runs[r].size;
+        for (unsigned w = 1; w < workerNum; ++w)
+        {
+            bounds[r][w] = lowerBound(*inputs[r], runs[r].size, sample[sample.size() * w / workerNum]);
+        }
+        for (unsigned w = 0; w <= workerNum; ++w)
+        {
+            outputBegins[w] += bounds[r][w];
+        }
+    }
+
+    bucketsort_detail::runOnWorkers(pool, workerNum, [&](unsigned w) {
+        typedef std::pair<uint64_t, size_t> HeapEntry; // key of the next value and the cursor it is in
+        std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+        std::vector<RunCursor> cursors(runs.size());
+        for (size_t r = 0; r < runs.size(); ++r)
+        {
+            cursors[r] = RunCursor{inputs[r].get(), bounds[r][w], bounds[r][w + 1], std::vector<unsigned>(bufferSize), 0, 0};
+            if (cursors[r].refill())
+            {
+                heap.emplace(Key::toKey(cursors[r].buffer[0]), r);
+            }
+        }
+
+        std::vector<unsigned> merged;
+        merged.reserve(bufferSize);
+        size_t outputOffset = outputBegins[w];
+        auto flush = [&] {
+            output.write(merged.data(), merged.size() * sizeof(unsigned), outputOffset * sizeof(unsigned));
+            outputOffset += merged.size();
+            merged.clear();
+        };
+
+        while (!heap.empty())
+        {
+            RunCursor &cursor = cursors[heap.top().second];
+            heap.pop();
+            merged.push_back(cursor.buffer[cursor.position]);
+            if (merged.size() == bufferSize)
+            {
+                flush();
+            }
+            if (++cursor.position < cursor.filled || cursor.refill())
+            {
+                heap.emplace(Key::toKey(cursor.buffer[cursor.position]), &cursor - cursors.data());
+            }
+        }
+        flush();
+    });
+}
+
+void ExternalSort::sort(const std::string &inputPath, const std::string &outputPath) const
+{
+    // every merge worker holds one buffer per run plus one for its output, and a run is at least one buffer long.
+    // checked before anything is read, a budget too small to merge would fail only after all runs were written
+    const size_t maxBufferNum = memoryBudget / (MIN_BUFFER_SIZE * sizeof(unsigned));
+    const size_t minBudget = std::max(3 * MIN_BUFFER_SIZE * sizeof(unsigned), MIN_BUFFER_SIZE * BYTES_PER_VALUE);
+    if (memoryBudget < minBudget)
+    {
+        throw std::invalid_argument("memory budget is too small, it needs at least " + std::to_string(minBudget) + " bytes");
+    }
+
+    TempFiles tempFiles;
+    std::vector<Run> runs = makeRuns(inputPath, outputPath + ".run0.");
+    for (auto &run : runs)
+    {
+        tempFiles.paths.push_back(run.path);
+    }
+
+    if (runs.size() == 1)
+    {
+        if (std::rename(runs[0].path.c_str(), outputPath.c_str()) != 0)
+        {
+            throw std::runtime_error("cannot rename " + runs[0].path + " to " + outputPath + ": " + std::strerror(errno));
+        }
+        return;
+    }
+
+    // with more runs than buffers, merge groups of them into longer runs first
+    for (unsigned pass = 1; runs.size() + 1 > maxBufferNum; ++pass)
+    {
+        const size_t fanIn = maxBufferNum - 1;
+        std::vector<Run> longerRuns;
+        for (size_t begin = 0; begin < runs.size(); begin += fanIn)
+        {
+            std::vector<Run> group(runs.begin() + begin, runs.begin() + std::min(runs.size(), begin + fanIn));
+            Run run{outputPath + ".run" + std::to_string(pass) + "." + std::to_string(longerRuns.size()), 0};
+            for (auto &part : group)
+            {
+                run.size += part.size;
+            }
+            tempFiles.paths.push_back(run.path);
+            merge(group, run.path, 1, memoryBudget / ((group.size() + 1) * sizeof(unsigned)));
+            longerRuns.push_back(run);
+            for (auto &part : group)
+            {
+                std::remove(part.path.c_str());
+            }
+        }
+        runs.swap(longerRuns);
+    }
+
+    const unsigned workerNum = static_cast<unsigned>(std::min<size_t>(pool.getWorkerNum() + 1, maxBufferNum / (runs.size() + 1)));
+    merge(runs, outputPath, workerNum, memoryBudget / (workerNum * (runs.size() + 1) * sizeof(unsigned)));
+}
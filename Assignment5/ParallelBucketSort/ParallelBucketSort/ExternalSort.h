@@ -0,0 +1,45 @@
+//
+//  ExternalSort.h
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#ifndef ExternalSort_h
+#define ExternalSort_h
+
+#include "BucketSorter.h"
+#include <string>
+
+/**
+ *sorts a binary file of native unsigned ints that may be much bigger than memory into another file, in the same
+ *lexicographic order as BucketSort. the input is read in runs that fit the memory budget, each run is sorted by
+ *BucketSorter and written to a temporary file next to the output, then the runs are merged by all workers at once,
+ *each worker merging its own key range straight into its place in the output
+ */
+class ExternalSort
+{
+  public:
+    // memoryBudget is in bytes, it caps the buffers of both the run and the merge phase
+    ExternalSort(ThreadPool &pool, size_t memoryBudget, SortEngine engine = SortEngine::Bucket);
+
+    // throws std::invalid_argument before touching any file if the budget is too small for a run or the merge
+    void sort(const std::string &inputPath, const std::string &outputPath) const;
+
+  private:
+    struct Run
+    {
+        std::string path;
+        size_t size; // number of values
+    };
+
+    ThreadPool &pool;
+    size_t memoryBudget;
+    SortEngine engine;
+
+    std::vector<Run> makeRuns(const std::string &inputPath, const std::string &tempPrefix) const;
+    void merge(const std::vector<Run> &runs, const std::string &outputPath, unsigned workerNum, size_t bufferSize) const;
+};
+
+#endif /* ExternalSort_h */
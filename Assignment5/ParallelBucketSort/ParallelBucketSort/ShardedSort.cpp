@@ -0,0 +1,335 @@
+//
+//  ShardedSort.cpp
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#include "ShardedSort.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace
+{
+    typedef LexicographicKey<unsigned int> Key;
+
+    // the prefix buckets of Key, grouped into contiguous runs of buckets, one per shard
+    struct ShardClassifier
+    {
+        bucketsort_detail::PrefixClassifier<Key> inner;
+        std::vector<unsigned> shardOfBuckets;
+
+        unsigned getBucketNum() const
+        {
+            return shardOfBuckets.back() + 1;
+        }
+
+        unsigned operator()(Key::key_type key) const
+        {
+            return shardOfBuckets[inner(key)];
+        }
+
+        bool isSorted(unsigned) const
+        {
+            return false;
+        }
+    };
+
+    const char *WORKER_FLAG = "--sharded-sort-worker";
+    const int WORKER_SHARED_FD = 3; // where a worker finds the shared memory file
+    const int WORKER_STATUS_FD = 4; // and the write end of its status pipe
+    const int FIRST_FREE_FD = 5;    // coordinator fds handed to a worker are moved above both first
+
+    // a MAP_SHARED mapping of a memory file, which the workers map as well and write to, and the coordinator sees
+    class SharedMemory
+    {
+      public:
+        // a new memory file of the given size, or the one open at fd if it is not -1
+        explicit SharedMemory(size_t bytes, int fd = -1) : bytes(bytes), fd(fd)
+        {
+            if (fd < 0)
+            {
+                int created = ::memfd_create("ShardedSort", MFD_CLOEXEC);
+                this->fd = created < 0 ? -1 : ::fcntl(created, F_DUPFD_CLOEXEC, FIRST_FREE_FD);
+                if (created >= 0)
+                {
+                    ::close(created);
+                }
+                if (this->fd < 0 || ::ftruncate(this->fd, bytes) != 0)
+                {
+                    int error = errno;
+                    closeFd();
+                    throw std::runtime_error(std::string("cannot create shared memory: ") + std::strerror(error));
+                }
+            }
+            data = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+            if (data == MAP_FAILED)
+            {
+                int error = errno;
+                closeFd();
+                throw std::runtime_error(std::string("cannot map shared memory: ") + std::strerror(error));
+            }
+        }
+
+        ~SharedMemory()
+        {
+            ::munmap(data, bytes);
+            closeFd();
+        }
+
+        SharedMemory(const SharedMemory &) = delete;
+        SharedMemory &operator=(const SharedMemory &) = delete;
+
+        unsigned *getNumbers() const
+        {
+            return static_cast<unsigned *>(data);
+        }
+
+        int getFd() const
+        {
+            return fd;
+        }
+
+      private:
+        void *data;
+        size_t bytes;
+        int fd;
+
+        void closeFd()
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+    };
+
+    void writeAll(int fd, const std::string &message)
+    {
+        for (size_t done = 0; done < message.size();)
+        {
+            ssize_t written = ::write(fd, message.data() + done, message.size() - done);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return;
+            }
+            done += written;
+        }
+    }
+}
+
+ShardedSort::ShardedSort(ThreadPool &pool, unsigned workerNum, unsigned coresPerWorker, SortEngine engine) : pool(pool), workerNum(std::max(workerNum, 1u)), coresPerWorker(std::max(coresPerWorker, 1u)), engine(engine)
+{
+}
+
+/**
+ *permute the numbers in place into one shard per worker, by their longest prefix buckets so that the shards can be
+ *cut close to even. return where every shard begins, with the total at the end
+ */
+std::vector<size_t> ShardedSort::partition(unsigned *numbers, size_t total) const
+{
+    ShardClassifier classifier;
+    classifier.inner.length = Key::MAX_PREFIX_LENGTH;
+    std::vector<size_t> bucketBegins = bucketsort_detail::sumBuckets(bucketsort_detail::countBuckets<unsigned, Key>(pool, numbers, total, classifier.inner));
+
+    // a bucket goes to the shard its first number would be in if the shards were cut evenly
+    std::vector<size_t> shardBegins(1, 0);
+    for (size_t b = 0; b + 1 < bucketBegins.size(); ++b)
+    {
+        unsigned shard = static_cast<unsigned>(bucketBegins[b] * workerNum / total);
+        while (shardBegins.size() <= shard)
+        {
+            shardBegins.push_back(bucketBegins[b]);
+        }
+        classifier.shardOfBuckets.push_back(static_cast<unsigned>(shardBegins.size() - 1));
+    }
+    shardBegins.push_back(total);
+
+    bucketsort_detail::permuteInPlace<unsigned, Key>(pool, numbers, total, classifier, shardBegins);
+    return shardBegins;
+}
+
+ShardedSort::Worker ShardedSort::startWorker(int sharedFd, size_t begin, size_t size) const
+{
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) != 0)
+    {
+        throw std::runtime_error(std::string("cannot create a pipe: ") + std::strerror(errno));
+    }
+    // the write end goes above the fds the worker gets, so that placing one never overwrites the other
+    int statusFd = ::fcntl(fds[1], F_DUPFD_CLOEXEC, FIRST_FREE_FD);
+    int error = errno;
+    ::close(fds[1]);
+    if (statusFd < 0)
+    {
+        ::close(fds[0]);
+        throw std::runtime_error(std::string("cannot create a pipe: ") + std::strerror(error));
+    }
+
+    // the program itself, dispatched to runWorker by its arguments. only the two fds moved into place are
+    // inherited, the rest of the coordinator's are close-on-exec or not the worker's business
+    std::vector<std::string> arguments = {"/proc/self/exe", WORKER_FLAG, std::to_string(begin), std::to_string(size), std::to_string(coresPerWorker), std::to_string(static_cast<int>(engine))};
+    std::vector<char *> argv;
+    for (auto &argument : arguments)
+    {
+        argv.push_back(&argument[0]);
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sharedFd, WORKER_SHARED_FD);
+    posix_spawn_file_actions_adddup2(&actions, statusFd, WORKER_STATUS_FD);
+    pid_t pid;
+    error = ::posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(statusFd);
+    if (error != 0)
+    {
+        ::close(fds[0]);
+        throw std::runtime_error(std::string("cannot start a worker: ") + std::strerror(error));
+    }
+    return Worker{pid, fds[0]};
+}
+
+int ShardedSort::runWorker(int argc, const char *argv[])
+{
+    if (argc != 6 || std::string(argv[1]) != WORKER_FLAG)
+    {
+        return -1;
+    }
+    int status = 0;
+    try
+    {
+        const size_t begin = std::stoull(argv[2]);
+        const size_t size = std::stoull(argv[3]);
+        const unsigned cores = static_cast<unsigned>(std::stoul(argv[4]));
+        const SortEngine engine = static_cast<SortEngine>(std::stoi(argv[5]));
+
+        struct stat info;
+        if (::fstat(WORKER_SHARED_FD, &info) != 0)
+        {
+            throw std::runtime_error(std::string("cannot find the shared memory: ") + std::strerror(errno));
+        }
+        SharedMemory shared(info.st_size, WORKER_SHARED_FD);
+        ThreadPool workerPool{std::max(cores, 1u) - 1};
+        unsigned *shard = shared.getNumbers() + begin;
+        BucketSorter<unsigned>(workerPool, engine).sort(shard, shard + size);
+    }
+    catch (const std::exception &e)
+    {
+        writeAll(WORKER_STATUS_FD, e.what());
+        status = 1;
+    }
+    ::close(WORKER_STATUS_FD);
+    return status;
+}
+
+std::string ShardedSort::waitWorker(const Worker &worker) const
+{
+    std::string message;
+    char buffer[256];
+    for (;;)
+    {
+        ssize_t done = ::read(worker.statusFd, buffer, sizeof(buffer));
+        if (done < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (done <= 0)
+        {
+            break;
+        }
+        message.append(buffer, done);
+    }
+    ::close(worker.statusFd);
+
+    int status;
+    while (::waitpid(worker.pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return std::string("cannot wait for worker: ") + std::strerror(errno);
+        }
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        return "";
+    }
+    if (message.empty())
+    {
+        message = WIFSIGNALED(status) ? "killed by signal " + std::to_string(WTERMSIG(status)) : "exited with " + std::to_string(WEXITSTATUS(status));
+    }
+    return "worker " + std::to_string(worker.pid) + " failed: " + message;
+}
+
+void ShardedSort::sort(std::vector<unsigned> &numbers) const
+{
+    const size_t total = numbers.size();
+    if (total == 0)
+    {
+        return;
+    }
+
+    SharedMemory shared(total * sizeof(unsigned));
+    unsigned *sharedNumbers = shared.getNumbers();
+    bucketsort_detail::runOnWorkers(pool, pool.getWorkerNum() + 1, [&](unsigned w) {
+        const unsigned n = pool.getWorkerNum() + 1;
+        std::copy(numbers.data() + bucketsort_detail::getSliceBegin(total, n, w), numbers.data() + bucketsort_detail::getSliceBegin(total, n, w + 1),
+                  sharedNumbers + bucketsort_detail::getSliceBegin(total, n, w));
+    });
+    std::vector<size_t> shardBegins = partition(sharedNumbers, total);
+
+    std::vector<Worker> workers;
+    std::string error;
+    for (size_t s = 0; s + 1 < shardBegins.size(); ++s)
+    {
+        if (shardBegins[s] == shardBegins[s + 1])
+        {
+            continue;
+        }
+        try
+        {
+            workers.push_back(startWorker(shared.getFd(), shardBegins[s], shardBegins[s + 1] - shardBegins[s]));
+        }
+        catch (const std::runtime_error &e)
+        {
+            error = e.what(); // still wait for the workers already running
+            break;
+        }
+    }
+    for (auto &worker : workers)
+    {
+        std::string workerError = waitWorker(worker);
+        if (error.empty())
+        {
+            error = workerError;
+        }
+    }
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+
+    // the shards are in bucket order, so the mapping is the sorted numbers
+    bucketsort_detail::runOnWorkers(pool, pool.getWorkerNum() + 1, [&](unsigned w) {
+        const unsigned n = pool.getWorkerNum() + 1;
+        std::copy(sharedNumbers + bucketsort_detail::getSliceBegin(total, n, w), sharedNumbers + bucketsort_detail::getSliceBegin(total, n, w + 1),
+                  numbers.data() + bucketsort_detail::getSliceBegin(total, n, w));
+    });
+}
@@ -0,0 +1,55 @@
+//
+//  ShardedSort.h
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#ifndef ShardedSort_h
+#define ShardedSort_h
+
+#include "BucketSorter.h"
+#include <string>
+
+/**
+ *sorts unsigned ints with several worker processes on the same host, in the same lexicographic order as
+ *BucketSort, the local stand-in for sorting on several nodes. the coordinator range-partitions the numbers by their
+ *leading digits into one shard per worker, in bucket order, inside a shared memory file. every worker is a new
+ *process with a pool of its own that maps the file, sorts its shard there with BucketSorter and reports back
+ *through a pipe, so its buffers live in its own address space. the shards are then already concatenated in order.
+ *
+ *the workers are started with posix_spawn of the running program, never a bare fork: the coordinator's pool has
+ *threads, and the child of a multithreaded fork may only make async-signal-safe calls. so the program that uses
+ *ShardedSort must hand its arguments to runWorker first thing in main, and exit with its status unless it is -1
+ */
+class ShardedSort
+{
+  public:
+    // pool is the coordinator's, for partitioning. every worker sorts with coresPerWorker threads
+    ShardedSort(ThreadPool &pool, unsigned workerNum, unsigned coresPerWorker, SortEngine engine = SortEngine::Bucket);
+
+    void sort(std::vector<unsigned> &numbers) const;
+
+    // the entry point of a worker process, see above. -1 if these are not the arguments of a worker
+    static int runWorker(int argc, const char *argv[]);
+
+  private:
+    // a running worker process
+    struct Worker
+    {
+        int pid;
+        int statusFd; // read end of the pipe the worker writes its error to, if it fails
+    };
+
+    ThreadPool &pool;
+    unsigned workerNum;
+    unsigned coresPerWorker;
+    SortEngine engine;
+
+    std::vector<size_t> partition(unsigned *numbers, size_t total) const;
+    Worker startWorker(int sharedFd, size_t begin, size_t size) const;
+    std::string waitWorker(const Worker &worker) const; // empty if the worker succeeded
+};
+
+#endif /* ShardedSort_h */
@@ -0,0 +1,242 @@
+//
+//  SimdSort.cpp
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#include "SimdSort.h"
+#include <memory>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BUCKETSORT_AVX2 1
+#include <immintrin.h>
+#endif
+
+#ifdef BUCKETSORT_AVX2
+namespace
+{
+    // AVX2 only compares signed 64 bit lanes, so the keys are sorted with their top bit flipped
+    const uint64_t SIGN_BIT = uint64_t(1) << 63;
+    const size_t BLOCK_SIZE = 16; // keys sorted in registers at a time
+
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+
+    AVX2_FUNCTION inline void minMax(__m256i &a, __m256i &b)
+    {
+        __m256i greater = _mm256_cmpgt_epi64(a, b);
+        __m256i min = _mm256_blendv_epi8(a, b, greater);
+        b = _mm256_blendv_epi8(b, a, greater);
+        a = min;
+    }
+
+    AVX2_FUNCTION inline __m256i reverse(__m256i v)
+    {
+        return _mm256_permute4x64_epi64(v, 0x1B);
+    }
+
+    // sort the 4 lanes of a bitonic v
+    AVX2_FUNCTION inline __m256i cleanBitonic(__m256i v)
+    {
+        __m256i other = _mm256_permute4x64_epi64(v, 0x4E); // lanes 2 3 0 1
+        __m256i greater = _mm256_cmpgt_epi64(v, other);
+        __m256i min = _mm256_blendv_epi8(v, other, greater);
+        __m256i max = _mm256_blendv_epi8(other, v, greater);
+        v = _mm256_blend_epi32(min, max, 0xF0);
+
+        other = _mm256_permute4x64_epi64(v, 0xB1); // lanes 1 0 3 2
+        greater = _mm256_cmpgt_epi64(v, other);
+        min = _mm256_blendv_epi8(v, other, greater);
+        max = _mm256_blendv_epi8(other, v, greater);
+        return _mm256_blend_epi32(min, max, 0xCC);
+    }
+
+    // sorted a and b become the lower and upper halves of their merge
+    AVX2_FUNCTION inline void merge4(__m256i &a, __m256i &b)
+    {
+        b = reverse(b);
+        minMax(a, b);
+        a = cleanBitonic(a);
+        b = cleanBitonic(b);
+    }
+
+    // sorted a0 a1 and b0 b1 become the 16 keys of their merge
+    AVX2_FUNCTION inline void merge8(__m256i &a0, __m256i &a1, __m256i &b0, __m256i &b1)
+    {
+        __m256i reversed0 = reverse(b1);
+        __m256i reversed1 = reverse(b0);
+        minMax(a0, reversed0);
+        minMax(a1, reversed1);
+        // a0 a1 and reversed0 reversed1 are bitonic now, every key of the first below every key of the second
+        minMax(a0, a1);
+        minMax(reversed0, reversed1);
+        a0 = cleanBitonic(a0);
+        a1 = cleanBitonic(a1);
+        b0 = cleanBitonic(reversed0);
+        b1 = cleanBitonic(reversed1);
+    }
+
+    AVX2_FUNCTION void sortBlock(int64_t *keys)
+    {
+        __m256i r0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys));
+        __m256i r1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + 4));
+        __m256i r2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + 8));
+        __m256i r3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + 12));
+
+        // sort the 4 columns with the 5 comparators of a 4 key network, then transpose them into rows
+        minMax(r0, r1);
+        minMax(r2, r3);
+        minMax(r0, r2);
+        minMax(r1, r3);
+        minMax(r1, r2);
+        __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+        __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+        __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+        __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+        r0 = _mm256_permute2x128_si256(t0, t2, 0x20);
+        r1 = _mm256_permute2x128_si256(t1, t3, 0x20);
+        r2 = _mm256_permute2x128_si256(t0, t2, 0x31);
+        r3 = _mm256_permute2x128_si256(t1, t3, 0x31);
+
+        merge4(r0, r1);
+        merge4(r2, r3);
+        merge8(r0, r1, r2, r3);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys), r0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys + 4), r1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys + 8), r2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys + 12), r3);
+    }
+
+    /**
+     *merge sorted a and b into out, which overlaps neither. the 4 biggest keys so far stay in a register, every
+     *step loads the next 4 of the run whose next key is smaller and writes out the lower half of their merge.
+     *the last few keys of each run are merged one by one
+     */
+    AVX2_FUNCTION void mergeRuns(const int64_t *a, size_t aSize, const int64_t *b, size_t bSize, int64_t *out)
+    {
+        if (aSize < 4 || bSize < 4)
+        {
+            std::merge(a, a + aSize, b, b + bSize, out);
+            return;
+        }
+
+        __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+        __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+        size_t i = 4;
+        size_t j = 4;
+        merge4(low, high);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), low);
+        out += 4;
+        while (i + 4 <= aSize && j + 4 <= bSize)
+        {
+            if (a[i] < b[j])
+            {
+                low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+                i += 4;
+            }
+            else
+            {
+                low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+                j += 4;
+            }
+            merge4(low, high);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), low);
+            out += 4;
+        }
+
+        // merge what is left of a and b behind room for the 4 in the register, then those 4 in front of it
+        int64_t kept[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(kept), high);
+        int64_t *rest = out + 4;
+        int64_t *restEnd = std::merge(a + i, a + aSize, b + j, b + bSize, rest);
+        size_t k = 0;
+        while (k < 4)
+        {
+            if (rest == restEnd || kept[k] <= *rest)
+            {
+                *out++ = kept[k++];
+            }
+            else
+            {
+                *out++ = *rest++; // out never passes rest, 4 - k keys are still ahead of it
+            }
+        }
+    }
+
+    AVX2_FUNCTION void flipSignBits(uint64_t *keys, size_t total)
+    {
+        const __m256i sign = _mm256_set1_epi64x(static_cast<long long>(SIGN_BIT));
+        size_t i = 0;
+        for (; i + 4 <= total; i += 4)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys + i), _mm256_xor_si256(v, sign));
+        }
+        for (; i < total; ++i)
+        {
+            keys[i] ^= SIGN_BIT;
+        }
+    }
+
+    AVX2_FUNCTION void sortKeysAvx2(uint64_t *first, uint64_t *last)
+    {
+        const size_t total = last - first;
+        flipSignBits(first, total);
+        int64_t *keys = reinterpret_cast<int64_t *>(first);
+
+        size_t blockEnd = total - total % BLOCK_SIZE;
+        for (size_t i = 0; i < blockEnd; i += BLOCK_SIZE)
+        {
+            sortBlock(keys + i);
+        }
+        std::sort(keys + blockEnd, keys + total);
+
+        // bottom-up merge passes between keys and buffer
+        if (total > BLOCK_SIZE)
+        {
+            std::unique_ptr<int64_t[]> buffer(new int64_t[total]);
+            int64_t *src = keys;
+            int64_t *dst = buffer.get();
+            for (size_t width = BLOCK_SIZE; width < total; width *= 2)
+            {
+                for (size_t begin = 0; begin < total; begin += 2 * width)
+                {
+                    size_t mid = std::min(begin + width, total);
+                    size_t end = std::min(begin + 2 * width, total);
+                    mergeRuns(src + begin, mid - begin, src + mid, end - mid, dst + begin);
+                }
+                std::swap(src, dst);
+            }
+            if (src != keys)
+            {
+                std::copy(src, src + total, keys);
+            }
+        }
+        flipSignBits(first, total);
+    }
+}
+#endif
+
+bool bucketsort_detail::hasSimdSort()
+{
+#ifdef BUCKETSORT_AVX2
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    return hasAvx2;
+#else
+    return false;
+#endif
+}
+
+void bucketsort_detail::sortKeys(uint64_t *first, uint64_t *last)
+{
+#ifdef BUCKETSORT_AVX2
+    if (hasSimdSort())
+    {
+        sortKeysAvx2(first, last);
+        return;
+    }
+#endif
+    std::sort(first, last);
+}
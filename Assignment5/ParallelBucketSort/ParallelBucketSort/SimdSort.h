@@ -0,0 +1,53 @@
+//
+//  SimdSort.h
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#ifndef SimdSort_h
+#define SimdSort_h
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace bucketsort_detail
+{
+    const size_t SIMD_SORT_MAX_SIZE = 1 << 18; //above it the merge passes no longer fit in L2 and std::sort catches up
+
+    // whether this CPU runs the vectorized kernel of sortKeys, checked once
+    bool hasSimdSort();
+
+    /**
+     *sort 64 bit keys as plain integers. with AVX2 (checked at run time, the rest of the program needs no special
+     *flags), blocks of 16 keys are sorted in registers by a bitonic network and the blocks merged 4 keys at a time
+     *by bitonic merges, otherwise it is std::sort
+     */
+    void sortKeys(uint64_t *first, uint64_t *last);
+
+    // another unsigned 64 bit integer type, such as unsigned long long where uint64_t is unsigned long, has the same
+    // representation and goes to the same kernel
+    template <typename Key>
+    void sortKeys(Key *first, Key *last, std::true_type)
+    {
+        sortKeys(reinterpret_cast<uint64_t *>(first), reinterpret_cast<uint64_t *>(last));
+    }
+
+    // other keys have no vectorized kernel
+    template <typename Key>
+    void sortKeys(Key *first, Key *last, std::false_type)
+    {
+        std::sort(first, last);
+    }
+
+    template <typename Key>
+    void sortKeys(Key *first, Key *last)
+    {
+        sortKeys(first, last, std::integral_constant<bool, std::is_integral<Key>::value && std::is_unsigned<Key>::value && sizeof(Key) == sizeof(uint64_t)>());
+    }
+}
+
+#endif /* SimdSort_h */
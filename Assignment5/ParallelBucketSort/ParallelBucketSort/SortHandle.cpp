@@ -0,0 +1,75 @@
+//
+//  SortHandle.cpp
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#include "SortHandle.h"
+#include <algorithm>
+
+SortCancelled::SortCancelled() : std::runtime_error("the sort was cancelled")
+{
+}
+
+double SortProgress::getFraction() const
+{
+    const size_t total = totalNum;
+    if (total == 0)
+    {
+        return doneNum > 0 ? 1 : 0; // nothing to sort, done or not started
+    }
+    return std::min(1.0, static_cast<double>(doneNum) / total);
+}
+
+SortHandle::~SortHandle()
+{
+    if (!state)
+    {
+        return;
+    }
+    cancel();
+    try
+    {
+        wait();
+    }
+    catch (...)
+    {
+    }
+}
+
+bool SortHandle::isDone() const
+{
+    return state->isDone;
+}
+
+double SortHandle::getProgress() const
+{
+    return state->progress.getFraction();
+}
+
+void SortHandle::cancel()
+{
+    state->progress.isCancelled = true;
+}
+
+void SortHandle::wait()
+{
+    if (!state->isWaited)
+    {
+        try
+        {
+            state->group.wait();
+        }
+        catch (...)
+        {
+            state->exception = std::current_exception();
+        }
+        state->isWaited = true;
+    }
+    if (state->exception)
+    {
+        std::rethrow_exception(state->exception);
+    }
+}
@@ -0,0 +1,114 @@
+//
+//  SortHandle.h
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#ifndef SortHandle_h
+#define SortHandle_h
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+// thrown by a sort that was cancelled. the range still holds all of its values, in no particular order
+class SortCancelled : public std::runtime_error
+{
+  public:
+    SortCancelled();
+};
+
+/**
+ *how far a sort has come, and the switch to stop it. a sorter given one counts its work there as it goes, and
+ *once isCancelled is set it skips the sorting left and only puts every value back, then throws SortCancelled
+ */
+struct SortProgress
+{
+    std::atomic<size_t> doneNum{0};  // two steps per value, one to bucket it and one to sort it
+    std::atomic<size_t> totalNum{0};
+    std::atomic<bool> isCancelled{false};
+
+    // between 0 and 1
+    double getFraction() const;
+};
+
+namespace bucketsort_detail
+{
+    inline bool isCancelled(const SortProgress *progress)
+    {
+        return progress && progress->isCancelled;
+    }
+
+    inline void addProgress(SortProgress *progress, size_t doneNum)
+    {
+        if (progress)
+        {
+            progress->doneNum += doneNum;
+        }
+    }
+}
+
+/**
+ *a sort running in the background as a task of a pool, e.g. from BucketSorter::sortAsync. no thread is started
+ *for it, so any number of sorts share the cores of the pool. a thread that waits runs tasks of the pool meanwhile,
+ *with a pool without workers the sort only runs then. destroying the handle cancels the sort and waits for it.
+ *a handle is meant to be used by one thread
+ */
+class SortHandle
+{
+  public:
+    // run job(progress) on pool
+    template <typename Job>
+    SortHandle(ThreadPool &pool, Job job) : state(new State(pool))
+    {
+        State *state = this->state.get();
+        state->group.run([state, job]() mutable {
+            try
+            {
+                job(state->progress);
+            }
+            catch (...)
+            {
+                state->isDone = true;
+                throw;
+            }
+            state->isDone = true;
+        });
+    }
+
+    SortHandle(SortHandle &&) = default;
+    ~SortHandle();
+
+    bool isDone() const;
+
+    // the fraction of the sort done, between 0 and 1
+    double getProgress() const;
+
+    // ask the sort to stop, wait() then throws SortCancelled unless it had finished already
+    void cancel();
+
+    // block until the sort is over, rethrow what it threw, every time wait() is called
+    void wait();
+
+  private:
+    struct State
+    {
+        explicit State(ThreadPool &pool) : group(pool)
+        {
+        }
+
+        SortProgress progress;
+        std::atomic<bool> isDone{false};
+        bool isWaited = false;
+        std::exception_ptr exception;
+        TaskGroup group; // last, so that it waits for the sort before the rest goes away
+    };
+
+    std::unique_ptr<State> state; // null once moved from
+};
+
+#endif /* SortHandle_h */
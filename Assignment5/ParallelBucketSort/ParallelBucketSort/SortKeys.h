@@ -0,0 +1,290 @@
+//
+//  SortKeys.h
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#ifndef SortKeys_h
+#define SortKeys_h
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+/*
+ *key traits tell BucketSorter how to order a value type. every traits struct provides
+ *
+ *  key_type                an unsigned integer type, keys compare as plain integers
+ *  KEY_BITS                every key is below 2^KEY_BITS
+ *  MAX_PREFIX_LENGTH       the most prefix levels getPrefix accepts
+ *  isExact                 whether equal keys mean equal values in the order, if not, less breaks ties
+ *  isDecodable             whether fromKey gives the value back, then only keys are moved around while sorting
+ *  toKey(value)            a key that never goes against the order: toKey(a) < toKey(b) means a is before b
+ *  less(a, b)              the full order
+ *  getPrefixNum(length)    the number of different prefixes of the given length
+ *  getPrefix(key, length)  the bucket of a key, prefixes are in key order and longer ones refine shorter ones
+ */
+
+#if defined(__SIZEOF_INT128__)
+typedef unsigned __int128 uint128_t;
+#endif
+
+namespace bucketsort_detail
+{
+    // 10^0 ~ 10^N as K, built at compile time
+    template <typename K, unsigned N>
+    struct Pow10Table
+    {
+        K values[N + 1];
+
+        constexpr Pow10Table() : values()
+        {
+            K value = 1;
+            for (unsigned i = 0; i <= N; ++i)
+            {
+                values[i] = value;
+                value *= 10;
+            }
+        }
+    };
+
+    // the top 4 * length bits of a KEY_BITS wide key
+    template <typename K>
+    unsigned getBinaryPrefix(K key, unsigned keyBits, unsigned length)
+    {
+        return static_cast<unsigned>(key >> (keyBits - 4 * length));
+    }
+}
+
+/**
+ *the order of the decimal strings of unsigned integers, e.g. 1 < 10 < 100 < 2 < 20 < 3.
+ *the digits are left aligned to MAX_DIGITS places (42 -> 4200000000 for unsigned int) and the digit count
+ *breaks ties, so that a prefix sorts before its extensions (4 < 40 < 400)
+ */
+template <typename T>
+struct LexicographicKey
+{
+    static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value, "LexicographicKey needs an unsigned integer type or std::string");
+
+    static constexpr unsigned MAX_DIGITS = std::numeric_limits<T>::digits10 + 1; // 10 for unsigned int
+    static constexpr unsigned LENGTH_BITS = MAX_DIGITS < 16 ? 4 : 5;             // low bits of a key that store the digit count
+    static constexpr unsigned KEY_BITS = (MAX_DIGITS * 3322 + 999) / 1000 + LENGTH_BITS; // log2(10) = 3.3219...
+    static constexpr unsigned MAX_PREFIX_LENGTH = MAX_DIGITS < 3 ? MAX_DIGITS : 3;
+    static constexpr bool isExact = true;
+    static constexpr bool isDecodable = true;
+
+#if defined(__SIZEOF_INT128__)
+    typedef typename std::conditional<(KEY_BITS <= 64), uint64_t, uint128_t>::type key_type;
+#else
+    static_assert(KEY_BITS <= 64, "64-bit lexicographic keys need unsigned __int128");
+    typedef uint64_t key_type;
+#endif
+
+    static key_type getPow10(unsigned exponent)
+    {
+        static constexpr bucketsort_detail::Pow10Table<key_type, MAX_DIGITS> POW10{};
+        return POW10.values[exponent];
+    }
+
+    /**
+     *return the bits of i, e.g. i = 1000, then return 4
+     */
+    static unsigned getBits(T i)
+    {
+        unsigned bits = 1; //at least, 1 bit
+        while (bits < MAX_DIGITS && i >= getPow10(bits))
+        {
+            ++bits;
+        }
+        return bits;
+    }
+
+    static key_type toKey(T i)
+    {
+        unsigned bits = getBits(i);
+        return (i * getPow10(MAX_DIGITS - bits)) << LENGTH_BITS | bits;
+    }
+
+    static T fromKey(key_type key)
+    {
+        unsigned bits = static_cast<unsigned>(key & ((1u << LENGTH_BITS) - 1));
+        return static_cast<T>((key >> LENGTH_BITS) / getPow10(MAX_DIGITS - bits));
+    }
+
+    static bool less(T a, T b)
+    {
+        return toKey(a) < toKey(b);
+    }
+
+    static unsigned getPrefixNum(unsigned length)
+    {
+        return static_cast<unsigned>(getPow10(length));
+    }
+
+    /**
+     *return the first length digits, padded with 0s when the number is shorter, e.g. getPrefix(toKey(4096), 2) = 40
+     *and getPrefix(toKey(4), 2) = 40
+     */
+    static unsigned getPrefix(key_type key, unsigned length)
+    {
+        return static_cast<unsigned>((key >> LENGTH_BITS) / getPow10(MAX_DIGITS - length));
+    }
+};
+
+template <typename T>
+constexpr unsigned LexicographicKey<T>::MAX_DIGITS;
+template <typename T>
+constexpr unsigned LexicographicKey<T>::LENGTH_BITS;
+template <typename T>
+constexpr unsigned LexicographicKey<T>::KEY_BITS;
+template <typename T>
+constexpr unsigned LexicographicKey<T>::MAX_PREFIX_LENGTH;
+template <typename T>
+constexpr bool LexicographicKey<T>::isExact;
+template <typename T>
+constexpr bool LexicographicKey<T>::isDecodable;
+
+/**
+ *the byte order of strings, as std::string::compare. the key is the first 8 bytes, so strings sharing those
+ *are compared in full
+ */
+template <>
+struct LexicographicKey<std::string>
+{
+    typedef uint64_t key_type;
+
+    static constexpr unsigned KEY_BITS = 64;
+    static constexpr unsigned MAX_PREFIX_LENGTH = 3;
+    static constexpr bool isExact = false;
+    static constexpr bool isDecodable = false;
+
+    static key_type toKey(const std::string &s)
+    {
+        key_type key = 0;
+        const size_t length = s.size() < sizeof(key_type) ? s.size() : sizeof(key_type);
+        for (size_t i = 0; i < length; ++i)
+        {
+            key |= static_cast<key_type>(static_cast<unsigned char>(s[i])) << (8 * (sizeof(key_type) - 1 - i));
+        }
+        return key;
+    }
+
+    static bool less(const std::string &a, const std::string &b)
+    {
+        return a < b;
+    }
+
+    static unsigned getPrefixNum(unsigned length)
+    {
+        return 1u << (4 * length);
+    }
+
+    static unsigned getPrefix(key_type key, unsigned length)
+    {
+        return bucketsort_detail::getBinaryPrefix(key, KEY_BITS, length);
+    }
+};
+
+/**
+ *the numeric order of integers, signed ones included
+ */
+template <typename T>
+struct NumericKey
+{
+    static_assert(std::is_integral<T>::value, "NumericKey needs an integer type");
+
+    typedef typename std::make_unsigned<T>::type key_type;
+
+    static constexpr unsigned KEY_BITS = std::numeric_limits<key_type>::digits;
+    static constexpr unsigned MAX_PREFIX_LENGTH = KEY_BITS / 4 < 3 ? KEY_BITS / 4 : 3;
+    static constexpr bool isExact = true;
+    static constexpr bool isDecodable = true;
+
+    // flipping the sign bit puts negative numbers before the others
+    static constexpr key_type SIGN_FLIP = std::is_signed<T>::value ? key_type(1) << (KEY_BITS - 1) : 0;
+
+    static key_type toKey(T i)
+    {
+        return static_cast<key_type>(i) ^ SIGN_FLIP;
+    }
+
+    static T fromKey(key_type key)
+    {
+        return static_cast<T>(key ^ SIGN_FLIP);
+    }
+
+    static bool less(T a, T b)
+    {
+        return a < b;
+    }
+
+    static unsigned getPrefixNum(unsigned length)
+    {
+        return 1u << (4 * length);
+    }
+
+    static unsigned getPrefix(key_type key, unsigned length)
+    {
+        return bucketsort_detail::getBinaryPrefix(key, KEY_BITS, length);
+    }
+};
+
+template <typename T>
+constexpr unsigned NumericKey<T>::KEY_BITS;
+template <typename T>
+constexpr unsigned NumericKey<T>::MAX_PREFIX_LENGTH;
+template <typename T>
+constexpr bool NumericKey<T>::isExact;
+template <typename T>
+constexpr bool NumericKey<T>::isDecodable;
+template <typename T>
+constexpr typename NumericKey<T>::key_type NumericKey<T>::SIGN_FLIP;
+
+/**
+ *order records by one of their fields, in the order FieldTraits gives that field, e.g.
+ *FieldKey<Employee, unsigned, &Employee::id> sorts employees by the decimal strings of their ids
+ */
+template <typename Record, typename Field, Field Record::*field, typename FieldTraits = LexicographicKey<Field>>
+struct FieldKey
+{
+    typedef typename FieldTraits::key_type key_type;
+
+    static constexpr unsigned KEY_BITS = FieldTraits::KEY_BITS;
+    static constexpr unsigned MAX_PREFIX_LENGTH = FieldTraits::MAX_PREFIX_LENGTH;
+    static constexpr bool isExact = FieldTraits::isExact;
+    static constexpr bool isDecodable = false;
+
+    static key_type toKey(const Record &record)
+    {
+        return FieldTraits::toKey(record.*field);
+    }
+
+    static bool less(const Record &a, const Record &b)
+    {
+        return FieldTraits::less(a.*field, b.*field);
+    }
+
+    static unsigned getPrefixNum(unsigned length)
+    {
+        return FieldTraits::getPrefixNum(length);
+    }
+
+    static unsigned getPrefix(key_type key, unsigned length)
+    {
+        return FieldTraits::getPrefix(key, length);
+    }
+};
+
+template <typename Record, typename Field, Field Record::*field, typename FieldTraits>
+constexpr unsigned FieldKey<Record, Field, field, FieldTraits>::KEY_BITS;
+template <typename Record, typename Field, Field Record::*field, typename FieldTraits>
+constexpr unsigned FieldKey<Record, Field, field, FieldTraits>::MAX_PREFIX_LENGTH;
+template <typename Record, typename Field, Field Record::*field, typename FieldTraits>
+constexpr bool FieldKey<Record, Field, field, FieldTraits>::isExact;
+template <typename Record, typename Field, Field Record::*field, typename FieldTraits>
+constexpr bool FieldKey<Record, Field, field, FieldTraits>::isDecodable;
+
+#endif /* SortKeys_h */
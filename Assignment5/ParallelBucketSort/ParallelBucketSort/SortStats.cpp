@@ -0,0 +1,108 @@
+//
+//  SortStats.cpp
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#include "SortStats.h"
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+    void writeString(std::ostream &out, const std::string &s)
+    {
+        out << '"';
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out << '\\';
+            }
+            out << c;
+        }
+        out << '"';
+    }
+
+    template <typename V>
+    void writeArray(std::ostream &out, const std::vector<V> &values)
+    {
+        out << '[';
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            out << (i ? "," : "") << values[i];
+        }
+        out << ']';
+    }
+}
+
+void SortStats::clear()
+{
+    workerNum = 0;
+    phaseSeconds.clear();
+    bucketSizes.clear();
+    bucketSortSeconds.clear();
+    workerPartitionSeconds.clear();
+    bytesMoved = 0;
+    workerCpus.clear();
+    workerNodes.clear();
+}
+
+double SortStats::getPhaseSeconds(const std::string &phase) const
+{
+    double seconds = 0;
+    for (auto &phaseSecond : phaseSeconds)
+    {
+        if (phaseSecond.first == phase)
+        {
+            seconds += phaseSecond.second;
+        }
+    }
+    return seconds;
+}
+
+double SortStats::getIdleSeconds() const
+{
+    double busy = std::accumulate(workerPartitionSeconds.begin(), workerPartitionSeconds.end(), 0.0) +
+                  std::accumulate(bucketSortSeconds.begin(), bucketSortSeconds.end(), 0.0);
+    double available = (getPhaseSeconds("partition") + getPhaseSeconds("sort")) * workerNum;
+    return std::max(0.0, available - busy);
+}
+
+double SortStats::getImbalance() const
+{
+    size_t total = 0;
+    size_t nonEmpty = 0;
+    size_t largest = 0;
+    for (size_t size : bucketSizes)
+    {
+        total += size;
+        nonEmpty += size > 0;
+        largest = std::max(largest, size);
+    }
+    return total == 0 ? 1 : static_cast<double>(largest) * nonEmpty / total;
+}
+
+void SortStats::writeJson(std::ostream &out) const
+{
+    out << "{\"workerNum\":" << workerNum << ",\"phaseSeconds\":{";
+    for (size_t i = 0; i < phaseSeconds.size(); ++i)
+    {
+        out << (i ? "," : "");
+        writeString(out, phaseSeconds[i].first);
+        out << ':' << phaseSeconds[i].second;
+    }
+    out << "},\"bucketSizes\":";
+    writeArray(out, bucketSizes);
+    out << ",\"bucketSortSeconds\":";
+    writeArray(out, bucketSortSeconds);
+    out << ",\"workerPartitionSeconds\":";
+    writeArray(out, workerPartitionSeconds);
+    out << ",\"workerCpus\":";
+    writeArray(out, workerCpus);
+    out << ",\"workerNodes\":";
+    writeArray(out, workerNodes);
+    out << ",\"idleSeconds\":" << getIdleSeconds() << ",\"imbalance\":" << getImbalance() << ",\"bytesMoved\":" << bytesMoved << '}';
+}
@@ -0,0 +1,114 @@
+//
+//  SortStats.h
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#ifndef SortStats_h
+#define SortStats_h
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ *what a sort measured about itself, filled in only when a sorter is given one. every sort starts it afresh.
+ *without one, a sort reads no clocks and the hot loops are the same, so it can be left compiled in
+ */
+struct SortStats
+{
+    unsigned workerNum = 0; // threads that sorted, the calling one included
+
+    // wall time of every phase in the order they ran, e.g. {"partition", 0.12}
+    std::vector<std::pair<std::string, double>> phaseSeconds;
+
+    std::vector<size_t> bucketSizes;           // values per bucket
+    std::vector<double> bucketSortSeconds;     // time spent sorting each bucket, summed over the tasks it was split into
+    std::vector<double> workerPartitionSeconds; // time each worker spent counting and scattering its slice
+    size_t bytesMoved = 0;                     // bytes written to move values and keys between arrays
+
+    // where every worker of the pool (the last is the calling thread) ran: CPU and NUMA node, -1 if unknown or unpinned
+    std::vector<int> workerCpus;
+    std::vector<int> workerNodes;
+
+    void clear();
+
+    // wall time of the phase, 0 if it did not run
+    double getPhaseSeconds(const std::string &phase) const;
+
+    // thread time in the partition and sort phases that no worker spent on them
+    double getIdleSeconds() const;
+
+    // the biggest bucket over the mean non-empty one, 1 when perfectly even
+    double getImbalance() const;
+
+    void writeJson(std::ostream &out) const;
+};
+
+namespace bucketsort_detail
+{
+    // times the scope it lives in as one phase of stats, does nothing without stats
+    class PhaseTimer
+    {
+      public:
+        PhaseTimer(SortStats *stats, const char *name) : stats(stats), name(name)
+        {
+            if (stats)
+            {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~PhaseTimer()
+        {
+            if (stats)
+            {
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                stats->phaseSeconds.emplace_back(name, elapsed.count());
+            }
+        }
+
+        PhaseTimer(const PhaseTimer &) = delete;
+        PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+      private:
+        SortStats *stats;
+        const char *name;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // adds the time the scope it lives in takes to nanoseconds, which tasks on several threads may share
+    class BusyTimer
+    {
+      public:
+        explicit BusyTimer(std::atomic<long long> *nanoseconds) : nanoseconds(nanoseconds)
+        {
+            if (nanoseconds)
+            {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~BusyTimer()
+        {
+            if (nanoseconds)
+            {
+                *nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+
+        BusyTimer(const BusyTimer &) = delete;
+        BusyTimer &operator=(const BusyTimer &) = delete;
+
+      private:
+        std::atomic<long long> *nanoseconds;
+        std::chrono::steady_clock::time_point start;
+    };
+}
+
+#endif /* SortStats_h */
@@ -0,0 +1,230 @@
+//
+//  StreamingSorter.h
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#ifndef StreamingSorter_h
+#define StreamingSorter_h
+
+#include "BucketSorter.h"
+#include <iterator>
+#include <memory>
+#include <mutex>
+
+namespace bucketsort_detail
+{
+    const size_t STREAM_TASK_SIZE = 1 << 16; //values of a pushed chunk that one background task buckets
+    const size_t MERGE_FAN_IN = 8;           //sorted runs of one level a bucket collects before the background merges them
+
+    /**
+     *merge sorted runs into one, two at a time
+     */
+    template <typename Items>
+    std::vector<typename Items::item_type> mergeRuns(std::vector<std::vector<typename Items::item_type>> runs)
+    {
+        typedef typename Items::item_type Item;
+        while (runs.size() > 1)
+        {
+            std::vector<std::vector<Item>> merged;
+            for (size_t i = 0; i + 1 < runs.size(); i += 2)
+            {
+                std::vector<Item> run(runs[i].size() + runs[i + 1].size());
+                std::merge(std::make_move_iterator(runs[i].begin()), std::make_move_iterator(runs[i].end()),
+                           std::make_move_iterator(runs[i + 1].begin()), std::make_move_iterator(runs[i + 1].end()),
+                           run.begin(), Items::less);
+                merged.push_back(std::move(run));
+            }
+            if (runs.size() % 2)
+            {
+                merged.push_back(std::move(runs.back()));
+            }
+            runs.swap(merged);
+        }
+        return runs.empty() ? std::vector<Item>() : std::move(runs.front());
+    }
+}
+
+/**
+ *sorts values that arrive in chunks, in the order KeyTraits gives, so that most of the work is done while the
+ *producer is still producing. every pushed chunk is bucketed by key prefixes and sorted per bucket on the pool in
+ *the background. each bucket keeps its sorted runs in levels: MERGE_FAN_IN runs of one level are merged into a run
+ *of the next, so every value is merged O(log(chunks)) times and finish() only has to wait for the last chunk and
+ *merge a few runs per bucket.
+ *push() and finish() are meant to be called by one producer thread
+ */
+template <typename T, typename KeyTraits = LexicographicKey<T>>
+class StreamingSorter
+{
+  public:
+    explicit StreamingSorter(ThreadPool &pool) : pool(pool), prefixLength(0), group(pool)
+    {
+    }
+
+    StreamingSorter(const StreamingSorter &) = delete;
+    StreamingSorter &operator=(const StreamingSorter &) = delete;
+
+    // bucket a chunk in the background, the chunk is moved in so the producer can go on at once
+    void push(std::vector<T> chunk)
+    {
+        if (chunk.empty())
+        {
+            return;
+        }
+        if (prefixLength == 0)
+        {
+            // the first chunk stands in for the whole stream when choosing the buckets
+            prefixLength = bucketsort_detail::choosePrefixLength<T, KeyTraits>(chunk.data(), chunk.size(), pool.getWorkerNum() + 1);
+            buckets.clear();
+            for (unsigned b = 0; b < KeyTraits::getPrefixNum(prefixLength); ++b)
+            {
+                buckets.emplace_back(new Bucket);
+            }
+        }
+
+        std::shared_ptr<std::vector<T>> values = std::make_shared<std::vector<T>>(std::move(chunk));
+        for (size_t begin = 0; begin < values->size(); begin += bucketsort_detail::STREAM_TASK_SIZE)
+        {
+            size_t end = std::min(values->size(), begin + bucketsort_detail::STREAM_TASK_SIZE);
+            group.run([this, values, begin, end] {
+                addRuns(values->data() + begin, values->data() + end);
+            });
+        }
+    }
+
+    void push(const T *first, const T *last)
+    {
+        push(std::vector<T>(first, last));
+    }
+
+    /**
+     *wait for the chunks still being bucketed, and return every value pushed so far in order. the sorter is empty
+     *again afterwards
+     */
+    std::vector<T> finish()
+    {
+        group.wait();
+
+        std::vector<size_t> bucketBegins(buckets.size() + 1, 0);
+        for (size_t b = 0; b < buckets.size(); ++b)
+        {
+            size_t size = 0;
+            for (auto &level : buckets[b]->levels)
+            {
+                for (auto &run : level)
+                {
+                    size += run.size();
+                }
+            }
+            bucketBegins[b + 1] = bucketBegins[b] + size;
+        }
+
+        std::vector<T> sorted(bucketBegins.back());
+        for (size_t b = 0; b < buckets.size(); ++b)
+        {
+            if (bucketBegins[b] == bucketBegins[b + 1])
+            {
+                continue;
+            }
+            Bucket *bucket = buckets[b].get();
+            T *out = sorted.data() + bucketBegins[b];
+            group.run([bucket, out] {
+                std::vector<Run> runs;
+                for (auto &level : bucket->levels)
+                {
+                    std::move(level.begin(), level.end(), std::back_inserter(runs));
+                }
+                Run run = bucketsort_detail::mergeRuns<Items>(std::move(runs));
+                for (size_t i = 0; i < run.size(); ++i)
+                {
+                    Items::toValue(run[i], out[i]);
+                }
+            });
+        }
+        group.wait();
+
+        buckets.clear();
+        prefixLength = 0;
+        return sorted;
+    }
+
+  private:
+    typedef bucketsort_detail::SortItems<T, KeyTraits> Items;
+
+    typedef std::vector<typename Items::item_type> Run; // sorted
+
+    struct Bucket
+    {
+        std::mutex mutex;
+        std::vector<std::vector<Run>> levels; // a run of level l + 1 is MERGE_FAN_IN runs of level l merged
+    };
+
+    ThreadPool &pool;
+    unsigned prefixLength; // 0 until the first chunk arrives
+    std::vector<std::unique_ptr<Bucket>> buckets;
+    TaskGroup group; // last, so that it waits for the tasks before the buckets go away
+
+    // a background task: bucket values, sort them per bucket and hand every bucket its new run
+    void addRuns(T *first, T *last)
+    {
+        const size_t total = last - first;
+        const unsigned bucketNum = static_cast<unsigned>(buckets.size());
+        auto getBucket = [this](const T &value) {
+            return KeyTraits::getPrefix(KeyTraits::toKey(value), prefixLength);
+        };
+
+        std::vector<size_t> bucketBegins(bucketNum + 1, 0);
+        for (size_t i = 0; i < total; ++i)
+        {
+            ++bucketBegins[getBucket(first[i]) + 1];
+        }
+        for (unsigned b = 0; b < bucketNum; ++b)
+        {
+            bucketBegins[b + 1] += bucketBegins[b];
+        }
+        std::vector<size_t> offsets(bucketBegins.begin(), bucketBegins.end() - 1);
+        Run items(total);
+        for (size_t i = 0; i < total; ++i)
+        {
+            unsigned bucket = getBucket(first[i]);
+            items[offsets[bucket]++] = Items::toItem(first[i]);
+        }
+
+        for (unsigned b = 0; b < bucketNum; ++b)
+        {
+            if (bucketBegins[b] == bucketBegins[b + 1])
+            {
+                continue;
+            }
+            auto begin = std::make_move_iterator(items.begin() + bucketBegins[b]);
+            auto end = std::make_move_iterator(items.begin() + bucketBegins[b + 1]);
+            Run run(begin, end);
+            bucketsort_detail::LeafSorter<Items>::sort(run.data(), run.data() + run.size());
+
+            // a full level is merged outside the lock, other tasks keep adding runs meanwhile
+            Bucket &bucket = *buckets[b];
+            for (size_t level = 0;; ++level)
+            {
+                std::vector<Run> full;
+                {
+                    std::lock_guard<std::mutex> lock(bucket.mutex);
+                    if (bucket.levels.size() == level)
+                    {
+                        bucket.levels.emplace_back();
+                    }
+                    bucket.levels[level].push_back(std::move(run));
+                    if (bucket.levels[level].size() < bucketsort_detail::MERGE_FAN_IN)
+                    {
+                        break;
+                    }
+                    full.swap(bucket.levels[level]);
+                }
+                run = bucketsort_detail::mergeRuns<Items>(std::move(full));
+            }
+        }
+    }
+};
+
+#endif /* StreamingSorter_h */
@@ -0,0 +1,399 @@
+//
+//  ThreadPool.cpp
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#include "ThreadPool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // which pool the current thread works for, and the index of its own queue there
+    thread_local const ThreadPool *currentPool = nullptr;
+    thread_local unsigned currentIndex = 0;
+
+    // the CPU a CallerPin pinned the current thread to, -1 if none
+    thread_local int callerPinnedCpu = -1;
+
+    // the CPUs this process may run on, in order, none if unknown
+    std::vector<int> getAllowedCpus()
+    {
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &set))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        return cpus;
+    }
+
+    bool pin(std::thread &thread, int cpu)
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+        (void)thread;
+        (void)cpu;
+        return false;
+#endif
+    }
+
+    // bind the calling thread to the given CPUs
+    bool pinSelf(const std::vector<int> &cpus)
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+        {
+            CPU_SET(cpu, &set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpus;
+        return false;
+#endif
+    }
+}
+
+ThreadPool::ThreadPool(unsigned workerNum, bool isPinned) : callerCpu(-1), queuedNum(0), sleepingNum(0), isStopping(false)
+{
+    for (unsigned i = 0; i <= workerNum; ++i)
+    {
+        queues.emplace_back(new WorkQueue);
+    }
+    std::vector<int> cpus = isPinned ? getAllowedCpus() : std::vector<int>();
+    if (!cpus.empty())
+    {
+        callerCpu = cpus[0];
+    }
+    for (unsigned i = 0; i < workerNum; ++i)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+        int cpu = cpus.empty() ? -1 : cpus[(i + 1) % cpus.size()];
+        workerCpus.push_back(cpu >= 0 && pin(workers.back(), cpu) ? cpu : -1);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        isStopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    // without workers, whatever is left runs here
+    while (runPendingTask())
+    {
+    }
+}
+
+unsigned ThreadPool::getWorkerNum() const
+{
+    return static_cast<unsigned>(workers.size());
+}
+
+int ThreadPool::getWorkerCpu(unsigned worker) const
+{
+    return workerCpus[worker];
+}
+
+unsigned ThreadPool::getCurrentWorker() const
+{
+    return getQueueIndex();
+}
+
+int ThreadPool::getCallerCpu() const
+{
+    return callerCpu;
+}
+
+int ThreadPool::getPinnedCpu() const
+{
+    unsigned index = getQueueIndex();
+    return index < getWorkerNum() ? workerCpus[index] : callerPinnedCpu;
+}
+
+int ThreadPool::getCurrentCpu()
+{
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+int ThreadPool::getCurrentNode()
+{
+#ifdef __linux__
+    unsigned cpu;
+    unsigned node;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+    {
+        return static_cast<int>(node);
+    }
+#endif
+    return -1;
+}
+
+unsigned ThreadPool::getQueueIndex() const
+{
+    return currentPool == this ? currentIndex : getWorkerNum();
+}
+
+bool ThreadPool::hasTaskFor(unsigned index) const
+{
+    return queuedNum > 0 || queues[index]->pinnedNum > 0;
+}
+
+void ThreadPool::submit(Task task)
+{
+    WorkQueue &queue = *queues[getQueueIndex()];
+    ++queuedNum; // count it first, so that queuedNum never drops below the number of queued tasks
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    // a sleeper registers itself before it checks queuedNum, so either it sees this task or we see it
+    if (sleepingNum > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wakeUp.notify_one();
+    }
+}
+
+void ThreadPool::submitTo(unsigned worker, Task task)
+{
+    WorkQueue &queue = *queues[worker];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.pinnedTasks.push_back(std::move(task));
+        ++queue.pinnedNum;
+    }
+    notifyAll(); // only the owner may take it, so waking one sleeper is not enough
+}
+
+bool ThreadPool::popPinnedTask(unsigned index, Task &task)
+{
+    WorkQueue &queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.pinnedTasks.empty())
+    {
+        return false;
+    }
+    task = std::move(queue.pinnedTasks.front());
+    queue.pinnedTasks.pop_front();
+    --queue.pinnedNum;
+    return true;
+}
+
+bool ThreadPool::popTask(unsigned index, bool fromBack, Task &task)
+{
+    WorkQueue &queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+    if (fromBack)
+    {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+    }
+    else
+    {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+    }
+    --queuedNum;
+    return true;
+}
+
+bool ThreadPool::runPendingTask()
+{
+    const unsigned own = getQueueIndex();
+    Task task;
+    if (queues[own]->pinnedNum > 0 && popPinnedTask(own, task))
+    {
+        task();
+        return true;
+    }
+    if (queuedNum == 0)
+    {
+        return false;
+    }
+
+    const unsigned queueNum = static_cast<unsigned>(queues.size());
+    bool found = popTask(own, true, task); // newest own task first, its data is still in cache
+    for (unsigned i = 1; !found && i < queueNum; ++i)
+    {
+        found = popTask((own + i) % queueNum, false, task); // steal the oldest, usually the biggest, task
+    }
+    if (found)
+    {
+        task();
+    }
+    return found;
+}
+
+void ThreadPool::notifyAll()
+{
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    wakeUp.notify_all();
+}
+
+void ThreadPool::workerLoop(unsigned index)
+{
+    currentPool = this;
+    currentIndex = index;
+
+    while (true)
+    {
+        if (runPendingTask())
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        ++sleepingNum;
+        wakeUp.wait(lock, [this, index] {
+            return isStopping || hasTaskFor(index);
+        });
+        --sleepingNum;
+        if (isStopping && !hasTaskFor(index))
+        {
+            return;
+        }
+    }
+}
+
+TaskGroup::TaskGroup(ThreadPool &pool) : pool(pool), pendingNum(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    // the tasks refer to this group, never leave them behind
+    try
+    {
+        wait();
+    }
+    catch (...)
+    {
+    }
+}
+
+ThreadPool &TaskGroup::getPool() const
+{
+    return pool;
+}
+
+void TaskGroup::run(ThreadPool::Task task)
+{
+    pool.submit(wrap(std::move(task)));
+}
+
+void TaskGroup::runOn(unsigned worker, ThreadPool::Task task)
+{
+    pool.submitTo(worker, wrap(std::move(task)));
+}
+
+ThreadPool::Task TaskGroup::wrap(ThreadPool::Task task)
+{
+    ++pendingNum;
+    ThreadPool *owner = &pool; // the group may be gone once pendingNum reaches 0, the pool is not
+    return [this, owner, task = std::move(task)] {
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(exceptionMutex);
+            if (!exception)
+            {
+                exception = std::current_exception();
+            }
+        }
+        if (--pendingNum == 0)
+        {
+            owner->notifyAll();
+        }
+    };
+}
+
+void TaskGroup::wait()
+{
+    while (pendingNum > 0)
+    {
+        if (pool.runPendingTask())
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(pool.sleepMutex);
+        ++pool.sleepingNum;
+        const unsigned own = pool.getQueueIndex();
+        pool.wakeUp.wait(lock, [this, own] {
+            return pendingNum == 0 || pool.hasTaskFor(own);
+        });
+        --pool.sleepingNum;
+    }
+
+    std::lock_guard<std::mutex> lock(exceptionMutex);
+    if (exception)
+    {
+        std::exception_ptr thrown = exception;
+        exception = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+CallerPin::CallerPin(const ThreadPool &pool) : cpu(-1)
+{
+    int callerCpu = pool.getCallerCpu();
+    if (callerCpu < 0 || pool.getPinnedCpu() >= 0)
+    {
+        return; // not a pinned pool, or the thread is pinned already
+    }
+    oldCpus = getAllowedCpus();
+    if (!oldCpus.empty() && pinSelf(std::vector<int>(1, callerCpu)))
+    {
+        cpu = callerCpu;
+        callerPinnedCpu = cpu;
+    }
+}
+
+CallerPin::~CallerPin()
+{
+    if (cpu >= 0)
+    {
+        pinSelf(oldCpus);
+        callerPinnedCpu = -1;
+    }
+}
@@ -0,0 +1,156 @@
+//
+//  ThreadPool.h
+//  ParallelBucketSort
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ *a fixed-size pool of worker threads with work stealing. every worker owns a deque: it pushes and pops its own
+ *tasks at the back, and idle workers steal from the front of the others. tasks submitted from outside the pool
+ *go to a shared queue that every worker steals from. idle workers sleep on a condition variable instead of polling.
+ *a pinned pool binds worker i to the (i + 1)th CPU the process may run on, the first is left to the thread that
+ *uses the pool, which takes it with a CallerPin. pinning only works on Linux, elsewhere the workers stay unpinned
+ */
+class ThreadPool
+{
+  public:
+    typedef std::function<void()> Task;
+
+    explicit ThreadPool(unsigned workerNum, bool isPinned = false);
+    ~ThreadPool(); // runs the tasks still queued, then joins the workers
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned getWorkerNum() const;
+
+    // the CPU worker is pinned to, -1 if it is not
+    int getWorkerCpu(unsigned worker) const;
+
+    // which worker the calling thread is, getWorkerNum() for a thread outside the pool
+    unsigned getCurrentWorker() const;
+
+    // the CPU left to the thread that uses the pool, -1 if the pool is not pinned
+    int getCallerCpu() const;
+
+    /**
+     *the CPU the calling thread is pinned to: its own if it is a worker of this pool, cpu of the CallerPin it
+     *holds otherwise. -1 if it is not pinned
+     */
+    int getPinnedCpu() const;
+
+    void submit(Task task);
+
+    // run the task on the given worker, it is never stolen by another
+    void submitTo(unsigned worker, Task task);
+
+    // where the calling thread runs right now, -1 if unknown
+    static int getCurrentCpu();
+    static int getCurrentNode(); // NUMA node
+
+    /**
+     *run one queued task on the calling thread, own deque first, then steal. return false if there was none
+     */
+    bool runPendingTask();
+
+  private:
+    friend class TaskGroup;
+
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::deque<Task> pinnedTasks; // only for the owner
+        std::atomic<size_t> pinnedNum{0};
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues; // one per worker, the last one for outside threads
+    std::vector<std::thread> workers;
+    std::vector<int> workerCpus;
+    int callerCpu;
+
+    std::atomic<size_t> queuedNum;
+    std::atomic<unsigned> sleepingNum;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool isStopping;
+
+    void workerLoop(unsigned index);
+    unsigned getQueueIndex() const; // the queue the calling thread owns
+    bool hasTaskFor(unsigned index) const; // whether the owner of the queue has anything to run
+    bool popTask(unsigned index, bool fromBack, Task &task);
+    bool popPinnedTask(unsigned index, Task &task);
+    void notifyAll();
+};
+
+/**
+ *pins the calling thread to the CPU a pinned pool left for it, as long as it lives, then restores the mask the
+ *thread had before. it does nothing for a pool that is not pinned, for a thread that is pinned already, or if
+ *pinning fails
+ */
+class CallerPin
+{
+  public:
+    explicit CallerPin(const ThreadPool &pool);
+    ~CallerPin();
+
+    CallerPin(const CallerPin &) = delete;
+    CallerPin &operator=(const CallerPin &) = delete;
+
+  private:
+    int cpu; // -1 if the thread was not pinned here
+    std::vector<int> oldCpus;
+};
+
+/**
+ *a set of tasks on a pool that can be waited for. tasks may add more tasks to their own group while running,
+ *wait() returns once all of them are done. the waiting thread runs queued tasks meanwhile, so a pool of n
+ *workers plus the waiting thread keeps n + 1 cores busy
+ */
+class TaskGroup
+{
+  public:
+    explicit TaskGroup(ThreadPool &pool);
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    ThreadPool &getPool() const;
+
+    void run(ThreadPool::Task task);
+
+    // run the task on the given worker of the pool, see ThreadPool::submitTo
+    void runOn(unsigned worker, ThreadPool::Task task);
+
+    /**
+     *block until every task of this group is done, rethrow the first exception one of them threw
+     */
+    void wait();
+
+  private:
+    ThreadPool &pool;
+    std::atomic<size_t> pendingNum;
+
+    std::mutex exceptionMutex;
+    std::exception_ptr exception;
+
+    ThreadPool::Task wrap(ThreadPool::Task task); // count the task in, and keep its exception
+};
+
+#endif /* ThreadPool_h */
@@ -8,12 +8,52 @@
 
 #include <iostream>
 #include <random>
+#include <stdexcept>
+#include <string>
 #include <thread>
 
 #include "BucketSort.h"
+#include "ExternalSort.h"
+#include "ShardedSort.h"
 
 int main(int argc, const char *argv[])
 {
+    // the worker processes of the sharded mode are this program too
+    const int workerStatus = ShardedSort::runWorker(argc, argv);
+    if (workerStatus >= 0)
+    {
+        return workerStatus;
+    }
+
+    // external mode, for files of unsigned ints bigger than memory:
+    // ParallelBucketSort --external <input file> <output file> [memory budget in MiB, 1024 by default]
+    if (argc >= 4 && std::string(argv[1]) == "--external")
+    {
+        try
+        {
+            size_t budgetMiB = 1024;
+            if (argc > 4)
+            {
+                const std::string value = argv[4];
+                if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+                {
+                    throw std::invalid_argument("memory budget must be a number of MiB, not " + value);
+                }
+                budgetMiB = std::stoul(value);
+            }
+            const size_t memoryBudget = budgetMiB << 20;
+            ThreadPool pool{std::max(std::thread::hardware_concurrency(), 1u) - 1};
+            ExternalSort(pool, memoryBudget).sort(argv[2], argv[3]);
+        }
+        catch (const std::exception &e)
+        {
+            // caught so that the stack unwinds and the temporary run files are removed
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     unsigned int totalNumbers = 500000;
     unsigned int printIndex = 259000;
 
@@ -33,7 +73,18 @@ int main(int argc, const char *argv[])
 
     // call sort giving the number of cores available.
     const unsigned int numCores = std::thread::hardware_concurrency();
-    pbs.sort(numCores);
+    // sharded mode, the cores split over several worker processes:
+    // ParallelBucketSort --processes <worker processes>
+    if (argc >= 3 && std::string(argv[1]) == "--processes")
+    {
+        const unsigned int processNum = std::max(std::stoul(argv[2]), 1ul);
+        ThreadPool pool{std::max(numCores, 1u) - 1};
+        ShardedSort(pool, processNum, std::max(numCores / processNum, 1u)).sort(pbs.numbersToSort);
+    }
+    else
+    {
+        pbs.sort(numCores);
+    }
 
     std::cout << "number of cores used: " << numCores << std::endl;
 
@@ -0,0 +1,357 @@
+//
+//  main.cpp
+//  Tests
+//
+//  Created by Ethan Xu on 16/10/26.
+//  Copyright © 2017 Ethan Xu. All rights reserved.
+//
+//  checks every sorting mode of ParallelBucketSort against the standard algorithms, build it with
+//  g++ -std=c++14 -O2 -pthread -I../ParallelBucketSort main.cpp ../ParallelBucketSort/ThreadPool.cpp ../ParallelBucketSort/SortStats.cpp ../ParallelBucketSort/SortHandle.cpp ../ParallelBucketSort/SimdSort.cpp ../ParallelBucketSort/ShardedSort.cpp -o Tests
+//  it prints what it checks and exits with 1 if anything failed
+//
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BucketSorter.h"
+#include "ShardedSort.h"
+#include "StreamingSorter.h"
+
+namespace
+{
+    typedef LexicographicKey<unsigned int> Key;
+
+    const size_t SIZES[] = {0, 1, 2, 1000, 200000};
+    const SortEngine ENGINES[] = {SortEngine::Bucket, SortEngine::Radix, SortEngine::InPlace, SortEngine::Sample};
+    const char *ENGINE_NAMES[] = {"bucket", "radix", "inplace", "sample"};
+
+    size_t failedNum = 0;
+
+    void check(bool isPassed, const std::string &what)
+    {
+        if (!isPassed)
+        {
+            std::cout << "FAILED: " << what << std::endl;
+            ++failedNum;
+        }
+    }
+
+    // spread out values, or mostly duplicates if isDuplicated
+    std::vector<unsigned> makeNumbers(size_t size, bool isDuplicated, unsigned seed = 1)
+    {
+        std::mt19937 mt(seed);
+        std::uniform_int_distribution<unsigned> dist(0, isDuplicated ? 500 : std::numeric_limits<unsigned>::max());
+        std::vector<unsigned> numbers(size);
+        for (auto &number : numbers)
+        {
+            number = dist(mt);
+        }
+        return numbers;
+    }
+
+    std::vector<unsigned> sortedCopy(std::vector<unsigned> numbers)
+    {
+        std::sort(numbers.begin(), numbers.end(), Key::less);
+        return numbers;
+    }
+
+    std::string describe(const std::string &mode, size_t engine, size_t size, bool isDuplicated)
+    {
+        return mode + ", " + ENGINE_NAMES[engine] + ", " + std::to_string(size) + (isDuplicated ? " duplicated" : "") + " numbers";
+    }
+
+    void testSort(ThreadPool &pool)
+    {
+        for (size_t e = 0; e < sizeof(ENGINES) / sizeof(ENGINES[0]); ++e)
+        {
+            BucketSorter<unsigned> sorter(pool, ENGINES[e]);
+            for (size_t size : SIZES)
+            {
+                for (bool isDuplicated : {false, true})
+                {
+                    std::vector<unsigned> numbers = makeNumbers(size, isDuplicated);
+                    std::vector<unsigned> expected = sortedCopy(numbers);
+                    sorter.sort(numbers.data(), numbers.data() + numbers.size());
+                    check(numbers == expected, describe("sort", e, size, isDuplicated));
+                }
+            }
+        }
+        std::cout << "sort checked" << std::endl;
+    }
+
+    // the payloads are the original indexes, so every one has to end up next to the value it started with
+    void testPayloads(ThreadPool &pool)
+    {
+        for (size_t e = 0; e < sizeof(ENGINES) / sizeof(ENGINES[0]); ++e)
+        {
+            BucketSorter<unsigned> sorter(pool, ENGINES[e]);
+            for (size_t size : SIZES)
+            {
+                for (bool isDuplicated : {false, true})
+                {
+                    const std::vector<unsigned> original = makeNumbers(size, isDuplicated);
+                    std::vector<unsigned> numbers = original;
+                    std::vector<size_t> payloads(size);
+                    std::iota(payloads.begin(), payloads.end(), 0);
+                    sorter.sort(numbers.data(), numbers.data() + numbers.size(), payloads.data());
+
+                    bool isPaired = true;
+                    for (size_t i = 0; i < size; ++i)
+                    {
+                        isPaired = isPaired && original[payloads[i]] == numbers[i];
+                    }
+                    std::sort(payloads.begin(), payloads.end());
+                    std::vector<size_t> indexes(size);
+                    std::iota(indexes.begin(), indexes.end(), 0);
+                    check(numbers == sortedCopy(original) && isPaired && payloads == indexes, describe("payload sort", e, size, isDuplicated));
+                }
+            }
+        }
+        std::cout << "payload sort checked" << std::endl;
+    }
+
+    void testArgsort(ThreadPool &pool)
+    {
+        for (size_t e = 0; e < sizeof(ENGINES) / sizeof(ENGINES[0]); ++e)
+        {
+            BucketSorter<unsigned> sorter(pool, ENGINES[e]);
+            for (size_t size : SIZES)
+            {
+                for (bool isDuplicated : {false, true})
+                {
+                    const std::vector<unsigned> numbers = makeNumbers(size, isDuplicated);
+                    std::vector<size_t> order = sorter.argsort(numbers.data(), numbers.data() + numbers.size());
+                    std::vector<unsigned> ordered;
+                    for (size_t i : order)
+                    {
+                        ordered.push_back(i < size ? numbers[i] : 0);
+                    }
+                    std::sort(order.begin(), order.end());
+                    std::vector<size_t> indexes(size);
+                    std::iota(indexes.begin(), indexes.end(), 0);
+                    check(order == indexes && ordered == sortedCopy(numbers), describe("argsort", e, size, isDuplicated));
+                }
+            }
+        }
+        std::cout << "argsort checked" << std::endl;
+    }
+
+    // pushed in chunks of different sizes, with empty ones in between, and finished twice to see it starts over
+    void testStreaming(ThreadPool &pool)
+    {
+        StreamingSorter<unsigned> sorter(pool);
+        for (size_t size : SIZES)
+        {
+            for (bool isDuplicated : {false, true})
+            {
+                const std::vector<unsigned> numbers = makeNumbers(size, isDuplicated);
+                for (size_t chunkSize : {size_t(1), size_t(777), size + 1})
+                {
+                    if (chunkSize == 1 && size > 1000)
+                    {
+                        continue; // one at a time is slow and says nothing new
+                    }
+                    for (size_t begin = 0; begin < size; begin += chunkSize)
+                    {
+                        sorter.push(numbers.data() + begin, numbers.data() + std::min(size, begin + chunkSize));
+                        sorter.push(std::vector<unsigned>());
+                    }
+                    check(sorter.finish() == sortedCopy(numbers), "streaming, chunks of " + std::to_string(chunkSize) + ", " + std::to_string(size) + (isDuplicated ? " duplicated" : "") + " numbers");
+                }
+            }
+        }
+        check(sorter.finish().empty(), "streaming, finish with nothing pushed");
+        std::cout << "streaming checked" << std::endl;
+    }
+
+    // the positions to cut at: both ends, the first and last value and one in between
+    std::vector<size_t> getCuts(size_t size)
+    {
+        std::vector<size_t> cuts = {0, size / 3, size};
+        if (size > 0)
+        {
+            cuts.push_back(1);
+            cuts.push_back(size - 1);
+        }
+        return cuts;
+    }
+
+    void testSelection(ThreadPool &pool)
+    {
+        for (size_t e = 0; e < sizeof(ENGINES) / sizeof(ENGINES[0]); ++e)
+        {
+            BucketSorter<unsigned> sorter(pool, ENGINES[e]);
+            for (size_t size : SIZES)
+            {
+                for (bool isDuplicated : {false, true})
+                {
+                    const std::vector<unsigned> original = makeNumbers(size, isDuplicated);
+                    const std::vector<unsigned> expected = sortedCopy(original);
+                    for (size_t cut : getCuts(size))
+                    {
+                        const std::string where = " at " + std::to_string(cut);
+
+                        std::vector<unsigned> numbers = original;
+                        sorter.partialSort(numbers.data(), numbers.data() + cut, numbers.data() + size);
+                        bool isPrefix = std::equal(numbers.begin(), numbers.begin() + cut, expected.begin());
+                        check(isPrefix && sortedCopy(numbers) == expected, describe("partialSort", e, size, isDuplicated) + where);
+
+                        numbers = original;
+                        sorter.nthElement(numbers.data(), numbers.data() + cut, numbers.data() + size);
+                        bool isSplit = true;
+                        if (cut < size)
+                        {
+                            isSplit = numbers[cut] == expected[cut];
+                            for (size_t i = 0; i < size; ++i)
+                            {
+                                isSplit = isSplit && !(i < cut ? Key::less(numbers[cut], numbers[i]) : Key::less(numbers[i], numbers[cut]));
+                            }
+                        }
+                        check(isSplit && sortedCopy(numbers) == expected, describe("nthElement", e, size, isDuplicated) + where);
+                    }
+                }
+            }
+        }
+        std::cout << "partialSort and nthElement checked" << std::endl;
+    }
+
+    void testSharded(ThreadPool &pool)
+    {
+        for (unsigned processNum : {1u, 2u, 3u})
+        {
+            for (size_t size : SIZES)
+            {
+                for (bool isDuplicated : {false, true})
+                {
+                    std::vector<unsigned> numbers = makeNumbers(size, isDuplicated);
+                    std::vector<unsigned> expected = sortedCopy(numbers);
+                    ShardedSort(pool, processNum, 2).sort(numbers);
+                    check(numbers == expected, "sharded, " + std::to_string(processNum) + " processes, " + std::to_string(size) + (isDuplicated ? " duplicated" : "") + " numbers");
+                }
+            }
+        }
+        std::cout << "sharded sort checked" << std::endl;
+    }
+
+    /**
+     *sortAsync left alone must sort, and cancelled at once, part way or after it is done it must either sort or
+     *throw SortCancelled with every value still there. at least one of the cancellations has to stop a sort
+     */
+    void testAsync(ThreadPool &pool)
+    {
+        size_t cancelledNum = 0;
+        for (size_t e = 0; e < sizeof(ENGINES) / sizeof(ENGINES[0]); ++e)
+        {
+            BucketSorter<unsigned> sorter(pool, ENGINES[e]);
+            for (size_t size : SIZES)
+            {
+                const std::vector<unsigned> original = makeNumbers(size, false);
+                const std::vector<unsigned> expected = sortedCopy(original);
+
+                std::vector<unsigned> numbers = original;
+                SortHandle handle = sorter.sortAsync(numbers.data(), numbers.data() + size);
+                handle.wait();
+                check(numbers == expected && handle.isDone() && handle.getProgress() == 1, describe("sortAsync", e, size, false));
+
+                for (double cancelAt : {0.0, 0.3, 1.0})
+                {
+                    numbers = original;
+                    SortHandle cancelled = sorter.sortAsync(numbers.data(), numbers.data() + size);
+                    while (!cancelled.isDone() && cancelled.getProgress() < cancelAt)
+                    {
+                        std::this_thread::yield();
+                    }
+                    if (cancelAt == 1.0)
+                    {
+                        cancelled.wait();
+                    }
+                    cancelled.cancel();
+                    bool isCancelled = false;
+                    try
+                    {
+                        cancelled.wait();
+                    }
+                    catch (const SortCancelled &)
+                    {
+                        isCancelled = true;
+                        ++cancelledNum;
+                    }
+                    const std::string what = describe("sortAsync cancelled at " + std::to_string(cancelAt), e, size, false);
+                    check(isCancelled ? sortedCopy(numbers) == expected : numbers == expected, what);
+                    check(!isCancelled || cancelAt < 1.0, what + " after it was done");
+                }
+            }
+        }
+        check(cancelledNum > 0, "sortAsync, no cancellation stopped a sort");
+        std::cout << "sortAsync checked, " << cancelledNum << " sorts cancelled" << std::endl;
+    }
+
+    // sortUnique as std::sort and std::unique, sortCounted as the runs std::unique leaves
+    void testDistinct(ThreadPool &pool)
+    {
+        for (size_t e = 0; e < sizeof(ENGINES) / sizeof(ENGINES[0]); ++e)
+        {
+            BucketSorter<unsigned> sorter(pool, ENGINES[e]);
+            for (size_t size : SIZES)
+            {
+                for (bool isDuplicated : {false, true})
+                {
+                    const std::vector<unsigned> original = makeNumbers(size, isDuplicated);
+                    std::vector<unsigned> expected = sortedCopy(original);
+                    std::vector<std::pair<unsigned, size_t>> expectedCounts;
+                    for (unsigned number : expected)
+                    {
+                        if (expectedCounts.empty() || expectedCounts.back().first != number)
+                        {
+                            expectedCounts.push_back({number, 0});
+                        }
+                        ++expectedCounts.back().second;
+                    }
+                    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+
+                    std::vector<unsigned> numbers = original;
+                    unsigned *end = sorter.sortUnique(numbers.data(), numbers.data() + size);
+                    check(std::vector<unsigned>(numbers.data(), end) == expected, describe("sortUnique", e, size, isDuplicated));
+
+                    numbers = original;
+                    check(sorter.sortCounted(numbers.data(), numbers.data() + size) == expectedCounts && numbers == original, describe("sortCounted", e, size, isDuplicated));
+                }
+            }
+        }
+        std::cout << "sortUnique and sortCounted checked" << std::endl;
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    // the worker processes of ShardedSort are this program too
+    const int workerStatus = ShardedSort::runWorker(argc, argv);
+    if (workerStatus >= 0)
+    {
+        return workerStatus;
+    }
+
+    ThreadPool pool{3};
+    testSort(pool);
+    testPayloads(pool);
+    testArgsort(pool);
+    testStreaming(pool);
+    testSelection(pool);
+    testSharded(pool);
+    testAsync(pool);
+    testDistinct(pool);
+
+    if (failedNum > 0)
+    {
+        std::cout << failedNum << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}